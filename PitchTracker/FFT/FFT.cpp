@@ -36,6 +36,7 @@
 #include "FFT.h"
 
 #include "RealFFTf.h"
+#include "RealFFTf48x.h"
 
 void DeinitFFT()
 {
@@ -116,11 +117,10 @@ void InverseRealFFT(int NumSamples, float *RealIn, float *ImagIn, float *RealOut
    ReleaseFFT(hFFT);
 }
 
-void RealInverseRealFFT(int NumSamples,	float *In, float *Out){
-	// Remap to RealFFTf() function
+// Shared by RealInverseRealFFT and FFTPlan::RealInverseRealFFT, pFFT is the NumSamples sized work buffer
+static void RealInverseRealFFT(HFFT hFFT, float *pFFT, float *In, float *Out){
+	int NumSamples = hFFT->Points * 2;
 	int i;
-	HFFT hFFT = GetFFT(NumSamples);
-	float *pFFT = new float[NumSamples];
 	// Copy the data into the processing buffer
 	pFFT[0] = In[0];
 	for(i=1; i<NumSamples/2; i++){
@@ -138,6 +138,13 @@ void RealInverseRealFFT(int NumSamples,	float *In, float *Out){
 	}
 	// Handle the (real-only) DC
 	Out[0] = pFFT[0];
+}
+
+void RealInverseRealFFT(int NumSamples,	float *In, float *Out){
+	// Remap to RealFFTf() function
+	HFFT hFFT = GetFFT(NumSamples);
+	float *pFFT = new float[NumSamples];
+	RealInverseRealFFT(hFFT, pFFT, In, Out);
 	delete [] pFFT;
 	ReleaseFFT(hFFT);
 }
@@ -154,12 +161,11 @@ void RealInverseRealFFT(int NumSamples,	float *In, float *Out){
  * of its code.
  */
 
-void PowerSpectrum(int NumSamples, float *In, float *Out)
+// Shared by PowerSpectrum and FFTPlan::PowerSpectrum, pFFT is the NumSamples sized work buffer
+static void PowerSpectrum(HFFT hFFT, float *pFFT, float *In, float *Out)
 {
-   // Remap to RealFFTf() function
+   int NumSamples = hFFT->Points * 2;
    int i;
-   HFFT hFFT = GetFFT(NumSamples);
-   float *pFFT = new float[NumSamples];
    // Copy the data into the processing buffer
    for(i=0; i<NumSamples; i++)
       pFFT[i] = In[i];
@@ -175,6 +181,288 @@ void PowerSpectrum(int NumSamples, float *In, float *Out)
    // Handle the (real-only) DC and Fs/2 bins
    Out[0] = pFFT[0]*pFFT[0];
    Out[i] = pFFT[1]*pFFT[1];
+}
+
+void PowerSpectrum(int NumSamples, float *In, float *Out)
+{
+   // Remap to RealFFTf() function
+   HFFT hFFT = GetFFT(NumSamples);
+   float *pFFT = new float[NumSamples];
+   PowerSpectrum(hFFT, pFFT, In, Out);
+   delete [] pFFT;
+   ReleaseFFT(hFFT);
+}
+
+/*
+ * RealAutocorrelation
+ *
+ * The power spectrum P of the zero padded data is real and even, so the
+ * autocorrelation is its DCT-I:
+ * Out[l] = P[0] + (-1)^l P[n] + 2 sum(P[k] cos(pi k l / n), k = 1..n-1)
+ * with n = NumSamples / 2. This is computed like cosft1 from Numerical Recipes
+ * by a real FFT of n values, reading the power spectrum directly from the
+ * bit reversed output of the first FFT.
+ */
+
+// Shared by RealAutocorrelation and FFTPlan::RealAutocorrelation
+// pFFT is the NumSamples sized work buffer, pHalf the one for the NumSamples / 2 sized FFT (+1)
+static void RealAutocorrelation(HFFT hFFT, float *pFFT, HFFT hHalfFFT, float *pHalf, float *In, float *Out, int MaxLag)
+{
+   int n = hFFT->Points;
+   int *BitReversed = hFFT->BitReversed;
+   int i;
+   if(MaxLag > n)
+      MaxLag = n;
+   for(i=0; i<n; i++)
+      pFFT[i] = In[i];
+
+   RealFFTfZeroPadded(pFFT, hFFT);
+
+   // Power of the DC and fs/2 bins
+   float p0 = pFFT[0]*pFFT[0];
+   float pn = pFFT[1]*pFFT[1];
+   float sum = 0.5f*(p0 - pn);
+   pHalf[0] = 0.5f*(p0 + pn);
+   int b = BitReversed[n/2];
+   pHalf[n/2] = pFFT[b]*pFFT[b] + pFFT[b+1]*pFFT[b+1];
+   for(i=1; i<n/2; i++) {
+      int b1 = BitReversed[i];
+      int b2 = BitReversed[n-i];
+      float pLow = pFFT[b1]*pFFT[b1] + pFFT[b1+1]*pFFT[b1+1];
+      float pHigh = pFFT[b2]*pFFT[b2] + pFFT[b2+1]*pFFT[b2+1];
+      // The sine table holds -sin(pi i / n) and -cos(pi i / n) at the same (bit reversed) position
+      float wi = -hFFT->SinTable[b1];
+      float wr = -hFFT->SinTable[b1+1];
+      float y1 = 0.5f*(pLow + pHigh);
+      float y2 = pLow - pHigh;
+      pHalf[i] = y1 - wi*y2;
+      pHalf[n-i] = y1 + wi*y2;
+      sum += wr*y2;
+   }
+
+   RealFFTf(pHalf, hHalfFFT);
+
+   // Even lags are the real parts, odd lags the running sum of the imaginary parts (only the bins for MaxLag are needed)
+   int *HalfBitReversed = hHalfFFT->BitReversed;
+   Out[0] = 2.f*pHalf[0];
+   if(MaxLag >= 1)
+      Out[1] = 2.f*sum;
+   for(i=1; 2*i<=MaxLag && i<n/2; i++) {
+      int b = HalfBitReversed[i];
+      Out[2*i] = 2.f*pHalf[b];
+      sum -= pHalf[b+1]; // RealFFTf uses exp(-j...), cosft1 expects exp(+j...)
+      if(2*i+1 <= MaxLag)
+         Out[2*i+1] = 2.f*sum;
+   }
+   if(MaxLag == n)
+      Out[n] = 2.f*pHalf[1];
+}
+
+void RealAutocorrelation(int NumSamples, float *In, float *Out, int MaxLag)
+{
+   HFFT hFFT = GetFFT(NumSamples);
+   HFFT hHalfFFT = GetFFT(NumSamples/2);
+   float *pFFT = new float[NumSamples];
+   float *pHalf = new float[NumSamples/2 + 1];
+   RealAutocorrelation(hFFT, pFFT, hHalfFFT, pHalf, In, Out, MaxLag);
+   delete [] pHalf;
    delete [] pFFT;
+   ReleaseFFT(hHalfFFT);
    ReleaseFFT(hFFT);
+}
+
+/*
+ * FFTPlan
+ */
+
+FFTPlan::FFTPlan(int NumSamples)
+{
+   mNumSamples = NumSamples;
+   mFFT = GetFFT(NumSamples);
+   mHalfFFT = GetFFT(NumSamples/2);
+   mBuffer = new float[NumSamples];
+   mHalfBuffer = new float[NumSamples/2 + 1];
+   mBatchBuffer = NULL;
+   mBatchHalfBuffer = NULL;
+   mCrossBuffer = NULL;
+}
+
+FFTPlan::~FFTPlan()
+{
+   delete [] mCrossBuffer;
+   delete [] mBatchHalfBuffer;
+   delete [] mBatchBuffer;
+   delete [] mHalfBuffer;
+   delete [] mBuffer;
+   ReleaseFFT(mHalfFFT);
+   ReleaseFFT(mFFT);
+}
+
+void FFTPlan::PowerSpectrum(float *In, float *Out)
+{
+   ::PowerSpectrum(mFFT, mBuffer, In, Out);
+}
+
+void FFTPlan::RealInverseRealFFT(float *In, float *Out)
+{
+   ::RealInverseRealFFT(mFFT, mBuffer, In, Out);
+}
+
+void FFTPlan::RealAutocorrelation(float *In, float *Out, int MaxLag)
+{
+   ::RealAutocorrelation(mFFT, mBuffer, mHalfFFT, mHalfBuffer, In, Out, MaxLag);
+}
+
+/*
+ * Same as RealAutocorrelation above, with the values of all channels
+ * interleaved (value i of channel c at i*Channels+c) and RealFFTfBatch48x
+ * doing the transforms for all of them at once.
+ * The loops between the FFTs have a fixed number of channels so the
+ * compiler can vectorize them.
+ */
+
+template<int Channels> static void BatchInterleave(int n, float **In, float *pFFT)
+{
+   for(int i=0; i<n; i++, pFFT+=Channels) {
+      for(int c=0; c<Channels; c++)
+         pFFT[c] = In[c] ? In[c][i] : 0.f;
+   }
+}
+
+template<int Channels> static void BatchPowerToHalf(HFFT hFFT, float *pFFT, float *pHalf, float *sum)
+{
+   int n = hFFT->Points;
+   int *BitReversed = hFFT->BitReversed;
+   int b = BitReversed[n/2];
+   for(int c=0; c<Channels; c++) {
+      float p0 = pFFT[c]*pFFT[c];
+      float pn = pFFT[Channels + c]*pFFT[Channels + c];
+      sum[c] = 0.5f*(p0 - pn);
+      pHalf[c] = 0.5f*(p0 + pn);
+      pHalf[n/2*Channels + c] = pFFT[b*Channels + c]*pFFT[b*Channels + c] + pFFT[(b+1)*Channels + c]*pFFT[(b+1)*Channels + c];
+   }
+   for(int i=1; i<n/2; i++) {
+      float *Low = pFFT + BitReversed[i]*Channels;
+      float *High = pFFT + BitReversed[n-i]*Channels;
+      float wi = -hFFT->SinTable[BitReversed[i]];
+      float wr = -hFFT->SinTable[BitReversed[i]+1];
+      float y1[Channels], y2[Channels];
+      for(int c=0; c<Channels; c++) {
+         float pLow = Low[c]*Low[c] + Low[Channels + c]*Low[Channels + c];
+         float pHigh = High[c]*High[c] + High[Channels + c]*High[Channels + c];
+         y1[c] = 0.5f*(pLow + pHigh);
+         y2[c] = pLow - pHigh;
+      }
+      for(int c=0; c<Channels; c++) {
+         pHalf[i*Channels + c] = y1[c] - wi*y2[c];
+         pHalf[(n-i)*Channels + c] = y1[c] + wi*y2[c];
+         sum[c] += wr*y2[c];
+      }
+   }
+}
+
+void FFTPlan::RealAutocorrelationBatch(float **In, float **Out, int Channels, int MaxLag)
+{
+   // Always 4 channels (an SSE vector or half an AVX one), 8 were not faster than 2 batches of 4
+   const int bc = MaxBatchChannels;
+   int n = mFFT->Points;
+   int i, c;
+   if(MaxLag > n)
+      MaxLag = n;
+   if(mHalfFFT->SimdTwiddles == NULL) { // Too small for RealFFTfBatch48x
+      for(c=0; c<Channels; c++) {
+         if(In[c] && Out[c])
+            RealAutocorrelation(In[c], Out[c], MaxLag);
+      }
+      return;
+   }
+   if(!mBatchBuffer) {
+      mBatchBuffer = new float[mNumSamples * bc];
+      mBatchHalfBuffer = new float[(n + 1) * bc];
+   }
+   float *pFFT = mBatchBuffer;
+   float *pHalf = mBatchHalfBuffer;
+   float *Inputs[MaxBatchChannels];
+   float sum[MaxBatchChannels];
+   for(c=0; c<bc; c++)
+      Inputs[c] = (c < Channels) ? In[c] : NULL;
+
+   BatchInterleave<bc>(n, Inputs, pFFT);
+   if(!RealFFTfBatch48x(pFFT, mFFT, bc, true)) {
+      for(c=0; c<Channels; c++) {
+         if(In[c] && Out[c])
+            RealAutocorrelation(In[c], Out[c], MaxLag);
+      }
+      return;
+   }
+   BatchPowerToHalf<bc>(mFFT, pFFT, pHalf, sum);
+   RealFFTfBatch48x(pHalf, mHalfFFT, bc, false);
+
+   int *HalfBitReversed = mHalfFFT->BitReversed;
+   for(c=0; c<Channels; c++) {
+      float *o = Out[c];
+      if(!o)
+         continue;
+      float s = sum[c];
+      o[0] = 2.f*pHalf[c];
+      if(MaxLag >= 1)
+         o[1] = 2.f*s;
+      for(i=1; 2*i<=MaxLag && i<n/2; i++) {
+         int b = HalfBitReversed[i];
+         o[2*i] = 2.f*pHalf[b*bc + c];
+         s -= pHalf[(b+1)*bc + c];
+         if(2*i+1 <= MaxLag)
+            o[2*i+1] = 2.f*s;
+      }
+      if(MaxLag == n)
+         o[n] = 2.f*pHalf[bc + c];
+   }
+}
+
+/*
+ * RealCrossCorrelations
+ *
+ * The cross correlation is the inverse FFT of conj(A) * B, so InB is
+ * transformed only once for all inputs. Like RealAutocorrelation the
+ * inputs are zero padded to NumSamples, so there is no wrap around.
+ */
+void FFTPlan::RealCrossCorrelations(float *InB, float **InA, float **Out, int Count, int MaxLag)
+{
+   int n = mFFT->Points;
+   int *BitReversed = mFFT->BitReversed;
+   int i, c;
+   if(MaxLag > n)
+      MaxLag = n;
+   if(!mCrossBuffer)
+      mCrossBuffer = new float[mNumSamples * 2];
+   float *pB = mBuffer;
+   float *pA = mCrossBuffer;
+   float *pC = mCrossBuffer + mNumSamples;
+   for(i=0; i<n; i++)
+      pB[i] = InB[i];
+   RealFFTfZeroPadded(pB, mFFT);
+
+   for(c=0; c<Count; c++) {
+      for(i=0; i<n; i++)
+         pA[i] = InA[c][i];
+      RealFFTfZeroPadded(pA, mFFT);
+      // The product goes to the normal order expected by InverseRealFFTf, the DC and fs/2 bins are real
+      pC[0] = pA[0]*pB[0];
+      pC[1] = pA[1]*pB[1];
+      for(i=1; i<n; i++) {
+         int b = BitReversed[i];
+         pC[2*i] = pA[b]*pB[b] + pA[b+1]*pB[b+1];
+         pC[2*i+1] = pA[b]*pB[b+1] - pA[b+1]*pB[b];
+      }
+      InverseRealFFTf(pC, mFFT);
+
+      // The output is bit reversed as well (and already divided by NumSamples)
+      float *o = Out[c];
+      for(i=0; 2*i<=MaxLag; i++) {
+         int b = BitReversed[i];
+         o[2*i] = mNumSamples*pC[b];
+         if(2*i+1 <= MaxLag)
+            o[2*i+1] = mNumSamples*pC[b+1];
+      }
+   }
 }
\ No newline at end of file
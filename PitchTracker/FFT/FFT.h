@@ -62,4 +62,60 @@ void InverseRealFFT(int NumSamples,
 
 void RealInverseRealFFT(int NumSamples,	float *In, float *Out);
 
+/*
+ * Autocorrelation of NumSamples/2 real values, which are zero padded to
+ * NumSamples so there is no wrap around. Gives the same as PowerSpectrum
+ * followed by RealInverseRealFFT on the padded data
+ * (Out[lag] = NumSamples * sum(In[i] * In[i + lag])), but only the lags up
+ * to MaxLag (at most NumSamples / 2) are calculated. The power spectrum stays
+ * in the (bit reversed) order of the FFT output and its inverse transform
+ * is done as a DCT of half the size, so this is a lot cheaper.
+ */
+void RealAutocorrelation(int NumSamples, float *In, float *Out, int MaxLag);
+
+/*
+ * An FFT of a fixed size with its own scratch buffer (the sine and bit
+ * reversal tables are shared read-only through GetFFT). Unlike the
+ * functions above it never allocates memory (except for the buffers of the
+ * first batch) or locks after construction, so each analyzer can own one
+ * and use it from its own thread.
+ */
+struct FFTParamType;
+
+class FFTPlan
+{
+ public:
+   explicit FFTPlan(int NumSamples);
+   ~FFTPlan();
+
+   int GetNumSamples() const { return mNumSamples; }
+   // Same as the functions with the same name above (for NumSamples of this plan)
+   void PowerSpectrum(float *In, float *Out);
+   void RealInverseRealFFT(float *In, float *Out);
+   void RealAutocorrelation(float *In, float *Out, int MaxLag);
+   // RealAutocorrelation of up to MaxBatchChannels inputs at once, one per SIMD lane
+   // Unused channels may have NULL for In and Out. The results equal those of single calls.
+   void RealAutocorrelationBatch(float **In, float **Out, int Channels, int MaxLag);
+   // Cross correlation of each of the Count inputs InA[c] with InB, zero padded like RealAutocorrelation:
+   // Out[c][lag] = NumSamples * sum(InA[c][i] * InB[i + lag]) for lag = 0..MaxLag (at most NumSamples / 2)
+   void RealCrossCorrelations(float *InB, float **InA, float **Out, int Count, int MaxLag);
+
+   static const int MaxBatchChannels = 4;
+
+ private:
+   FFTPlan(const FFTPlan&);
+   FFTPlan& operator=(const FFTPlan&);
+
+   int mNumSamples;
+   FFTParamType *mFFT;
+   FFTParamType *mHalfFFT;
+   float *mBuffer;
+   float *mHalfBuffer;
+   float *mBatchBuffer;
+   float *mBatchHalfBuffer;
+   float *mCrossBuffer;
+};
+
+/* Frees the unused shared FFT tables (see CleanupFFT). Call it only at shutdown after all PitchWorkers
+   are freed and no other thread analyzes or creates/frees an FFTPlan anymore */
 void DeinitFFT();
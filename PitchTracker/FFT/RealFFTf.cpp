@@ -18,6 +18,10 @@
 *                   and BitReversed tables so they don't need to be reallocated
 *                   and recomputed on every call.
 *                 - Added Reorder* functions to undo the bit-reversal
+*              Modified for Vocaluxe
+*                 - Made the table cache of GetFFT thread-safe and unlimited
+*                 - Tables are aligned for SIMD
+*                 - Added a table of the twiddles of the last stages for RealFFTf48x
 *
 *  Copyright (C) 2009  Philip VanBaren
 *
@@ -37,18 +41,45 @@
 */
 
 #include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
 
 #include "RealFFTf.h"
-#ifdef EXPERIMENTAL_EQ_SSE_THREADED
 #include "RealFFTf48x.h"
-#endif
 
 #ifndef M_PI
 #define	M_PI		3.14159265358979323846  /* pi */
 #endif
 
+/* Alignment of the tables (a cache line, enough for any SIMD load) */
+#define FFT_ALIGNMENT 64
+
+static void *AlignedMalloc(size_t size)
+{
+#ifdef _WIN32
+   return _aligned_malloc(size,FFT_ALIGNMENT);
+#else
+   void *p;
+   return posix_memalign(&p,FFT_ALIGNMENT,size) ? NULL : p;
+#endif
+}
+
+static void AlignedFree(void *p)
+{
+#ifdef _WIN32
+   _aligned_free(p);
+#else
+   free(p);
+#endif
+}
+
 /*
 *  Initialize the Sine table and Twiddle pointers (bit-reversed pointers)
 *  for the FFT routine.
@@ -72,13 +103,13 @@ HFFT InitializeFFT(int fftlen)
    */
    h->Points = fftlen/2;
 
-   if((h->SinTable=(fft_type *)malloc(2*h->Points*sizeof(fft_type)))==NULL)
+   if((h->SinTable=(fft_type *)AlignedMalloc(2*h->Points*sizeof(fft_type)))==NULL)
    {
       fprintf(stderr,"Error allocating memory for Sine table.\n");
       exit(8);
    }
 
-   if((h->BitReversed=(int *)malloc(h->Points*sizeof(int)))==NULL)
+   if((h->BitReversed=(int *)AlignedMalloc(h->Points*sizeof(int)))==NULL)
    {
       fprintf(stderr,"Error allocating memory for BitReversed.\n");
       exit(8);
@@ -99,6 +130,33 @@ HFFT InitializeFFT(int fftlen)
       h->SinTable[h->BitReversed[i]+1]=(fft_type)-cos(2*M_PI*i/(2*h->Points));
    }
 
+   /*
+   *  For each 2 groups g=2p,2p+1 of the stage with 2 butterflies per group
+   *  32 values: cos and sin (4 lanes each) of twiddle g of that stage for
+   *  both groups, then cos and sin of twiddles 2g and 2g+1 of the last stage
+   *  (2 lanes each, a complex value) for both groups.
+   */
+   h->SimdTwiddles=NULL;
+   if(h->Points>=8)
+   {
+      if((h->SimdTwiddles=(fft_type *)AlignedMalloc(4*h->Points*sizeof(fft_type)))==NULL)
+      {
+         fprintf(stderr,"Error allocating memory for SIMD twiddles.\n");
+         exit(8);
+      }
+      for(i=0;i<h->Points/4;i++)
+      {
+         fft_type *t=h->SimdTwiddles+32*(i/2)+4*(i%2);
+         for(int k=0;k<4;k++)
+         {
+            t[k]=h->SinTable[2*i+1];
+            t[8+k]=h->SinTable[2*i];
+            t[16+k]=h->SinTable[4*i+2*(k/2)+1];
+            t[24+k]=h->SinTable[4*i+2*(k/2)];
+         }
+      }
+   }
+
    return h;
 }
 
@@ -108,58 +166,91 @@ HFFT InitializeFFT(int fftlen)
 void EndFFT(HFFT h)
 {
    if(h->Points>0) {
-      free(h->BitReversed);
-      free(h->SinTable);
+      AlignedFree(h->SimdTwiddles);
+      AlignedFree(h->BitReversed);
+      AlignedFree(h->SinTable);
    }
    h->Points=0;
    free(h);
 }
 
-#define MAX_HFFT 10
-static HFFT hFFTArray[MAX_HFFT] = { NULL };
-static int nFFTLockCount[MAX_HFFT] = { 0 };
+/*
+*  Cache of the tables for GetFFT: A list that only grows (except in
+*  CleanupFFT), so it can be searched without a lock. New entries are
+*  created under a mutex and published at the head of the list.
+*/
+struct FFTCacheEntry
+{
+   HFFT hFFT;
+   std::atomic<int> LockCount;
+   FFTCacheEntry *Next;
+};
+
+static std::atomic<FFTCacheEntry *> FFTCache(NULL);
+static std::mutex FFTCacheMutex;
+
+static FFTCacheEntry *FindFFT(FFTCacheEntry *e,int Points)
+{
+   for(;e!=NULL && e->hFFT->Points!=Points;e=e->Next);
+   return e;
+}
 
 /* Get a handle to the FFT tables of the desired length */
 /* This version keeps common tables rather than allocating a new table every time */
+/* Thread-safe, and lock-free once the tables of this length exist */
 HFFT GetFFT(int fftlen)
 {
-   int h,n = fftlen/2;
-   for(h=0; (h<MAX_HFFT) && (hFFTArray[h] != NULL) && (n != hFFTArray[h]->Points); h++);
-   if(h<MAX_HFFT) {
-      if(hFFTArray[h] == NULL) {
-         hFFTArray[h] = InitializeFFT(fftlen);
-         nFFTLockCount[h] = 0;
+   int n=fftlen/2;
+   FFTCacheEntry *e=FindFFT(FFTCache.load(std::memory_order_acquire),n);
+   if(e==NULL) {
+      std::lock_guard<std::mutex> lock(FFTCacheMutex);
+      FFTCacheEntry *head=FFTCache.load(std::memory_order_relaxed);
+      e=FindFFT(head,n); // Another thread might have been faster
+      if(e==NULL) {
+         e=new FFTCacheEntry;
+         e->hFFT=InitializeFFT(fftlen);
+         e->LockCount.store(0,std::memory_order_relaxed);
+         e->Next=head;
+         FFTCache.store(e,std::memory_order_release);
       }
-      nFFTLockCount[h]++;
-      return hFFTArray[h];
-   } else {
-      // All buffers used, so fall back to allocating a new set of tables
-      return InitializeFFT(fftlen);;
    }
+   e->LockCount.fetch_add(1,std::memory_order_relaxed);
+   return e->hFFT;
 }
 
 /* Release a previously requested handle to the FFT tables */
 void ReleaseFFT(HFFT hFFT)
 {
-   int h;
-   for(h=0; (h<MAX_HFFT) && (hFFTArray[h] != hFFT); h++);
-   if(h<MAX_HFFT) {
-      nFFTLockCount[h]--;
+   FFTCacheEntry *e;
+   for(e=FFTCache.load(std::memory_order_acquire);e!=NULL && e->hFFT!=hFFT;e=e->Next);
+   if(e!=NULL) {
+      e->LockCount.fetch_sub(1,std::memory_order_relaxed);
    } else {
       EndFFT(hFFT);
    }
 }
 
 /* Deallocate any unused FFT tables */
+/* Not thread-safe: Lookups in GetFFT and ReleaseFFT walk the list without the lock, so no other thread may
+   call them meanwhile. That includes creating or freeing an FFTPlan and the RealFFT/PowerSpectrum helpers,
+   so all PitchWorkers must be freed and all other analysis threads stopped first (call it at shutdown). */
 void CleanupFFT()
 {
-   int h;
-   for(h=0; (h<MAX_HFFT); h++) {
-      if((nFFTLockCount[h] <= 0) && (hFFTArray[h] != NULL)) {
-         EndFFT(hFFTArray[h]);
-         hFFTArray[h] = NULL;
+   std::lock_guard<std::mutex> lock(FFTCacheMutex);
+   FFTCacheEntry *e=FFTCache.load(std::memory_order_relaxed);
+   FFTCacheEntry *kept=NULL;
+   while(e!=NULL) {
+      FFTCacheEntry *next=e->Next;
+      if(e->LockCount.load(std::memory_order_relaxed)<=0) {
+         EndFFT(e->hFFT);
+         delete e;
+      } else {
+         e->Next=kept;
+         kept=e;
       }
+      e=next;
    }
+   FFTCache.store(kept,std::memory_order_release);
 }
 
 /*
@@ -180,7 +271,7 @@ void CleanupFFT()
 *        values would be similar in amplitude to the input values, which is
 *        good when using fixed point arithmetic)
 */
-void RealFFTf(fft_type *buffer,HFFT h)
+static void RealFFTfStages(fft_type *buffer,HFFT h,int ButterfliesPerGroup)
 {
    fft_type *A,*B;
    fft_type *sptr;
@@ -189,8 +280,6 @@ void RealFFTf(fft_type *buffer,HFFT h)
    fft_type HRplus,HRminus,HIplus,HIminus;
    fft_type v1,v2,sin,cos;
 
-   int ButterfliesPerGroup=h->Points/2;
-
    /*
    *  Butterfly:
    *     Ain-----Aout
@@ -201,6 +290,8 @@ void RealFFTf(fft_type *buffer,HFFT h)
 
    endptr1=buffer+h->Points*2;
 
+   if(RealFFTfStages48x(buffer,h,ButterfliesPerGroup))
+      ButterfliesPerGroup=0;
    while(ButterfliesPerGroup>0)
    {
       A=buffer;
@@ -262,6 +353,23 @@ void RealFFTf(fft_type *buffer,HFFT h)
    buffer[1]=v1;
 }
 
+void RealFFTf(fft_type *buffer,HFFT h)
+{
+   RealFFTfStages(buffer,h,h->Points/2);
+}
+
+/*
+*  Same as RealFFTf for input whose second half is zero (e.g. zero padded
+*  for a correlation), only the first half of buffer needs to be filled.
+*  The first butterfly stage combines both halves with a twiddle factor of -1,
+*  which just copies the first half if the second one is zero.
+*/
+void RealFFTfZeroPadded(fft_type *buffer,HFFT h)
+{
+   memcpy(buffer+h->Points,buffer,h->Points*sizeof(fft_type));
+   RealFFTfStages(buffer,h,h->Points/4);
+}
+
 
 /* Description: This routine performs an inverse FFT to real data.
 *              This code is for floating point data.
@@ -338,6 +446,8 @@ void InverseRealFFTf(fft_type *buffer,HFFT h)
 
    endptr1=buffer+h->Points*2;
 
+   if(InverseRealFFTfStages48x(buffer,h))
+      ButterfliesPerGroup=0;
    while(ButterfliesPerGroup>0)
    {
       A=buffer;
@@ -5,16 +5,21 @@
 typedef struct FFTParamType {
    int *BitReversed;
    fft_type *SinTable;
+   fft_type *SimdTwiddles; /* Twiddles of the last 2 stages spread over SIMD lanes, NULL for less than 8 points */
    int Points;
 } FFTParam;
 #define HFFT FFTParam *
 
 HFFT InitializeFFT(int);
 void EndFFT(HFFT);
+/* Shared tables, GetFFT and ReleaseFFT are thread-safe. The tables must not be modified. */
 HFFT GetFFT(int);
 void ReleaseFFT(HFFT);
+/* Frees the unused shared tables. Not thread-safe: Stop all PitchWorkers and other analysis threads first,
+   no other thread may use the functions above (or create/free an FFTPlan) meanwhile */
 void CleanupFFT();
 void RealFFTf(fft_type *,HFFT);
+void RealFFTfZeroPadded(fft_type *,HFFT);
 void InverseRealFFTf(fft_type *,HFFT);
 void ReorderToTime(HFFT hFFT, fft_type *buffer, fft_type *TimeOut);
 void ReorderToFreq(HFFT hFFT, fft_type *buffer, fft_type *RealOut, fft_type *ImagOut);
@@ -0,0 +1,433 @@
+/*
+*  SSE/AVX versions of the butterfly stages of RealFFTf.cpp
+*
+*  Both buffers hold interleaved complex values and each group of
+*  butterflies shares one twiddle factor (sin,cos), so the butterflies of a
+*  group can be done side by side. With s = (sin,-sin) for the forward and
+*  s = (-sin,sin) for the inverse transform the scalar code is
+*     V = B*cos + swap(B)*s    (swap exchanges real and imaginary parts)
+*     forward: B = A + V; A = B - 2*V
+*     inverse: B = (A + V)*0.5; A = B - V
+*  The vector code computes A - V and A + V instead (and scales the inverse
+*  at the end of each pass), so the results differ from the scalar code by
+*  rounding. Two stages are done per pass (radix 4) to halve the loads and
+*  stores. The last two stages have less than a vector of butterflies per
+*  group, their twiddles are precomputed per lane in h->SimdTwiddles.
+*
+*  The batched version transforms several channels at once, each lane of a
+*  vector belonging to another channel, so it is just the scalar code on
+*  vectors (including the post-processing). It uses the same operations as
+*  the single transforms, so the results of both are identical.
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*/
+
+#include <string.h>
+
+#include "RealFFTf.h"
+#include "RealFFTf48x.h"
+#include "../SimdKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FFT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define FFT_TARGET(x)
+#else
+#define FFT_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+#ifdef FFT_X86
+
+/* V = B*W for the butterflies, s holds the sines with the sign of the transform */
+FFT_TARGET("sse2") static inline __m128 TwiddleSSE(__m128 b,__m128 c,__m128 s)
+{
+   return _mm_add_ps(_mm_mul_ps(b,c),_mm_mul_ps(_mm_shuffle_ps(b,b,_MM_SHUFFLE(2,3,0,1)),s));
+}
+
+FFT_TARGET("avx2") static inline __m256 TwiddleAVX(__m256 b,__m256 c,__m256 s)
+{
+   return _mm256_add_ps(_mm256_mul_ps(b,c),_mm256_mul_ps(_mm256_permute_ps(b,_MM_SHUFFLE(2,3,0,1)),s));
+}
+
+/* One radix-2 stage (at least 2 butterflies per group), one group at a time */
+FFT_TARGET("sse2") static void Radix2StageSSE(fft_type *buffer,HFFT h,int ButterfliesPerGroup,bool inverse)
+{
+   const __m128 scale=_mm_set1_ps(inverse ? 0.5f : 1.f);
+   const __m128 sign=inverse ? _mm_set_ps(0.f,-0.f,0.f,-0.f) : _mm_set_ps(-0.f,0.f,-0.f,0.f);
+   fft_type *endptr1=buffer+h->Points*2;
+   fft_type *sptr=h->SinTable;
+
+   for(fft_type *A=buffer;A<endptr1;A+=ButterfliesPerGroup*4,sptr+=2)
+   {
+      fft_type *B=A+ButterfliesPerGroup*2;
+      const __m128 c=_mm_set1_ps(sptr[1]);
+      const __m128 s=_mm_xor_ps(_mm_set1_ps(sptr[0]),sign);
+      for(int i=0;i<ButterfliesPerGroup*2;i+=4)
+      {
+         __m128 a=_mm_loadu_ps(A+i);
+         __m128 v=TwiddleSSE(_mm_loadu_ps(B+i),c,s);
+         _mm_storeu_ps(A+i,_mm_mul_ps(_mm_sub_ps(a,v),scale));
+         _mm_storeu_ps(B+i,_mm_mul_ps(_mm_add_ps(a,v),scale));
+      }
+   }
+}
+
+/* Same for AVX, at least 4 butterflies per group */
+FFT_TARGET("avx2") static void Radix2StageAVX(fft_type *buffer,HFFT h,int ButterfliesPerGroup,bool inverse)
+{
+   const __m256 scale=_mm256_set1_ps(inverse ? 0.5f : 1.f);
+   const __m256 sign=inverse ? _mm256_set_ps(0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f) : _mm256_set_ps(-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f);
+   fft_type *endptr1=buffer+h->Points*2;
+   fft_type *sptr=h->SinTable;
+
+   for(fft_type *A=buffer;A<endptr1;A+=ButterfliesPerGroup*4,sptr+=2)
+   {
+      fft_type *B=A+ButterfliesPerGroup*2;
+      const __m256 c=_mm256_set1_ps(sptr[1]);
+      const __m256 s=_mm256_xor_ps(_mm256_set1_ps(sptr[0]),sign);
+      for(int i=0;i<ButterfliesPerGroup*2;i+=8)
+      {
+         __m256 a=_mm256_loadu_ps(A+i);
+         __m256 v=TwiddleAVX(_mm256_loadu_ps(B+i),c,s);
+         _mm256_storeu_ps(A+i,_mm256_mul_ps(_mm256_sub_ps(a,v),scale));
+         _mm256_storeu_ps(B+i,_mm256_mul_ps(_mm256_add_ps(a,v),scale));
+      }
+   }
+}
+
+/*
+*  Two stages in one pass (radix 4), starting with at least 4 butterflies per
+*  group: The quarters Q0..Q3 of group g go through the butterflies
+*  (Q0,Q2) and (Q1,Q3) with twiddle g, then (Q0,Q1) with twiddle 2g and
+*  (Q2,Q3) with twiddle 2g+1 of the next stage.
+*/
+FFT_TARGET("sse2") static void Radix4StagesSSE(fft_type *buffer,HFFT h,int ButterfliesPerGroup,bool inverse)
+{
+   const __m128 scale=_mm_set1_ps(inverse ? 0.25f : 1.f);
+   const __m128 sign=inverse ? _mm_set_ps(0.f,-0.f,0.f,-0.f) : _mm_set_ps(-0.f,0.f,-0.f,0.f);
+   const int Quarter=ButterfliesPerGroup; /* Floats per quarter */
+   fft_type *endptr1=buffer+h->Points*2;
+   fft_type *sptr=h->SinTable;
+   fft_type *sptr2=h->SinTable;
+
+   for(fft_type *A=buffer;A<endptr1;A+=Quarter*4,sptr+=2,sptr2+=4)
+   {
+      const __m128 c=_mm_set1_ps(sptr[1]);
+      const __m128 s=_mm_xor_ps(_mm_set1_ps(sptr[0]),sign);
+      const __m128 c0=_mm_set1_ps(sptr2[1]);
+      const __m128 s0=_mm_xor_ps(_mm_set1_ps(sptr2[0]),sign);
+      const __m128 c1=_mm_set1_ps(sptr2[3]);
+      const __m128 s1=_mm_xor_ps(_mm_set1_ps(sptr2[2]),sign);
+      for(int i=0;i<Quarter;i+=4)
+      {
+         __m128 x0=_mm_loadu_ps(A+i);
+         __m128 x1=_mm_loadu_ps(A+Quarter+i);
+         __m128 v=TwiddleSSE(_mm_loadu_ps(A+2*Quarter+i),c,s);
+         __m128 u=TwiddleSSE(_mm_loadu_ps(A+3*Quarter+i),c,s);
+         __m128 y0=_mm_sub_ps(x0,v),y2=_mm_add_ps(x0,v);
+         __m128 p=TwiddleSSE(_mm_sub_ps(x1,u),c0,s0);
+         __m128 r=TwiddleSSE(_mm_add_ps(x1,u),c1,s1);
+         _mm_storeu_ps(A+i,_mm_mul_ps(_mm_sub_ps(y0,p),scale));
+         _mm_storeu_ps(A+Quarter+i,_mm_mul_ps(_mm_add_ps(y0,p),scale));
+         _mm_storeu_ps(A+2*Quarter+i,_mm_mul_ps(_mm_sub_ps(y2,r),scale));
+         _mm_storeu_ps(A+3*Quarter+i,_mm_mul_ps(_mm_add_ps(y2,r),scale));
+      }
+   }
+}
+
+/* Same for AVX, starting with at least 8 butterflies per group */
+FFT_TARGET("avx2") static void Radix4StagesAVX(fft_type *buffer,HFFT h,int ButterfliesPerGroup,bool inverse)
+{
+   const __m256 scale=_mm256_set1_ps(inverse ? 0.25f : 1.f);
+   const __m256 sign=inverse ? _mm256_set_ps(0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f) : _mm256_set_ps(-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f);
+   const int Quarter=ButterfliesPerGroup; /* Floats per quarter */
+   fft_type *endptr1=buffer+h->Points*2;
+   fft_type *sptr=h->SinTable;
+   fft_type *sptr2=h->SinTable;
+
+   for(fft_type *A=buffer;A<endptr1;A+=Quarter*4,sptr+=2,sptr2+=4)
+   {
+      const __m256 c=_mm256_set1_ps(sptr[1]);
+      const __m256 s=_mm256_xor_ps(_mm256_set1_ps(sptr[0]),sign);
+      const __m256 c0=_mm256_set1_ps(sptr2[1]);
+      const __m256 s0=_mm256_xor_ps(_mm256_set1_ps(sptr2[0]),sign);
+      const __m256 c1=_mm256_set1_ps(sptr2[3]);
+      const __m256 s1=_mm256_xor_ps(_mm256_set1_ps(sptr2[2]),sign);
+      for(int i=0;i<Quarter;i+=8)
+      {
+         __m256 x0=_mm256_loadu_ps(A+i);
+         __m256 x1=_mm256_loadu_ps(A+Quarter+i);
+         __m256 v=TwiddleAVX(_mm256_loadu_ps(A+2*Quarter+i),c,s);
+         __m256 u=TwiddleAVX(_mm256_loadu_ps(A+3*Quarter+i),c,s);
+         __m256 y0=_mm256_sub_ps(x0,v),y2=_mm256_add_ps(x0,v);
+         __m256 p=TwiddleAVX(_mm256_sub_ps(x1,u),c0,s0);
+         __m256 r=TwiddleAVX(_mm256_add_ps(x1,u),c1,s1);
+         _mm256_storeu_ps(A+i,_mm256_mul_ps(_mm256_sub_ps(y0,p),scale));
+         _mm256_storeu_ps(A+Quarter+i,_mm256_mul_ps(_mm256_add_ps(y0,p),scale));
+         _mm256_storeu_ps(A+2*Quarter+i,_mm256_mul_ps(_mm256_sub_ps(y2,r),scale));
+         _mm256_storeu_ps(A+3*Quarter+i,_mm256_mul_ps(_mm256_add_ps(y2,r),scale));
+      }
+   }
+}
+
+/*
+*  The last two stages (2 and 1 butterflies per group) in one pass, one
+*  group of 4 complex values c0..c3 per SSE vector pair: (c0,c2),(c1,c3)
+*  with one twiddle, then (c0,c1),(c2,c3) with one twiddle each, done side
+*  by side after shuffling to (c0,c2),(c1,c3). The twiddles come from
+*  h->SimdTwiddles (see InitializeFFT), already spread over the lanes.
+*/
+FFT_TARGET("sse2") static void LastStagesSSE(fft_type *buffer,HFFT h,bool inverse)
+{
+   const __m128 scale=_mm_set1_ps(inverse ? 0.25f : 1.f);
+   const __m128 sign=inverse ? _mm_set_ps(0.f,-0.f,0.f,-0.f) : _mm_set_ps(-0.f,0.f,-0.f,0.f);
+   fft_type *endptr1=buffer+h->Points*2;
+   const fft_type *tw=h->SimdTwiddles;
+
+   for(fft_type *A=buffer;A<endptr1;A+=16,tw+=32)
+   {
+      for(int g=0;g<2;g++)
+      {
+         fft_type *G=A+8*g;
+         const fft_type *t=tw+4*g;
+         __m128 x01=_mm_loadu_ps(G);
+         __m128 v=TwiddleSSE(_mm_loadu_ps(G+4),_mm_load_ps(t),_mm_xor_ps(_mm_load_ps(t+8),sign));
+         __m128 y01=_mm_sub_ps(x01,v),y23=_mm_add_ps(x01,v);
+         __m128 y02=_mm_shuffle_ps(y01,y23,_MM_SHUFFLE(1,0,1,0));
+         __m128 y13=_mm_shuffle_ps(y01,y23,_MM_SHUFFLE(3,2,3,2));
+         __m128 w=TwiddleSSE(y13,_mm_load_ps(t+16),_mm_xor_ps(_mm_load_ps(t+24),sign));
+         __m128 z02=_mm_mul_ps(_mm_sub_ps(y02,w),scale),z13=_mm_mul_ps(_mm_add_ps(y02,w),scale);
+         _mm_storeu_ps(G,_mm_shuffle_ps(z02,z13,_MM_SHUFFLE(1,0,1,0)));
+         _mm_storeu_ps(G+4,_mm_shuffle_ps(z02,z13,_MM_SHUFFLE(3,2,3,2)));
+      }
+   }
+}
+
+/* Same for AVX, two groups per vector pair */
+FFT_TARGET("avx2") static void LastStagesAVX(fft_type *buffer,HFFT h,bool inverse)
+{
+   const __m256 scale=_mm256_set1_ps(inverse ? 0.25f : 1.f);
+   const __m256 sign=inverse ? _mm256_set_ps(0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f) : _mm256_set_ps(-0.f,0.f,-0.f,0.f,-0.f,0.f,-0.f,0.f);
+   fft_type *endptr1=buffer+h->Points*2;
+   const fft_type *tw=h->SimdTwiddles;
+
+   for(fft_type *A=buffer;A<endptr1;A+=16,tw+=32)
+   {
+      __m256 g0=_mm256_loadu_ps(A);
+      __m256 g1=_mm256_loadu_ps(A+8);
+      __m256 x01=_mm256_permute2f128_ps(g0,g1,0x20);
+      __m256 v=TwiddleAVX(_mm256_permute2f128_ps(g0,g1,0x31),_mm256_load_ps(tw),_mm256_xor_ps(_mm256_load_ps(tw+8),sign));
+      __m256 y01=_mm256_sub_ps(x01,v),y23=_mm256_add_ps(x01,v);
+      __m256 y02=_mm256_shuffle_ps(y01,y23,_MM_SHUFFLE(1,0,1,0));
+      __m256 y13=_mm256_shuffle_ps(y01,y23,_MM_SHUFFLE(3,2,3,2));
+      __m256 w=TwiddleAVX(y13,_mm256_load_ps(tw+16),_mm256_xor_ps(_mm256_load_ps(tw+24),sign));
+      __m256 z02=_mm256_mul_ps(_mm256_sub_ps(y02,w),scale),z13=_mm256_mul_ps(_mm256_add_ps(y02,w),scale);
+      __m256 z01=_mm256_shuffle_ps(z02,z13,_MM_SHUFFLE(1,0,1,0));
+      __m256 z23=_mm256_shuffle_ps(z02,z13,_MM_SHUFFLE(3,2,3,2));
+      _mm256_storeu_ps(A,_mm256_permute2f128_ps(z01,z23,0x20));
+      _mm256_storeu_ps(A+8,_mm256_permute2f128_ps(z01,z23,0x31));
+   }
+}
+
+/* Butterfly stages of the batched RealFFTf, Channels/4 vectors per value */
+FFT_TARGET("sse2") static void BatchStagesSSE(fft_type *buffer,HFFT h,int Channels,int ButterfliesPerGroup)
+{
+   const int Complex=2*Channels; /* Floats per complex value */
+   fft_type *endptr1=buffer+h->Points*Complex;
+
+   for(;ButterfliesPerGroup>0;ButterfliesPerGroup>>=1)
+   {
+      fft_type *sptr=h->SinTable;
+      for(fft_type *A=buffer;A<endptr1;A+=ButterfliesPerGroup*2*Complex,sptr+=2)
+      {
+         fft_type *B=A+ButterfliesPerGroup*Complex;
+         const __m128 sin=_mm_set1_ps(sptr[0]);
+         const __m128 cos=_mm_set1_ps(sptr[1]);
+         for(int i=0;i<ButterfliesPerGroup*Complex;i+=Complex)
+         {
+            for(int c=i;c<i+Channels;c+=4)
+            {
+               __m128 ar=_mm_loadu_ps(A+c),ai=_mm_loadu_ps(A+c+Channels);
+               __m128 br=_mm_loadu_ps(B+c),bi=_mm_loadu_ps(B+c+Channels);
+               __m128 v1=_mm_add_ps(_mm_mul_ps(br,cos),_mm_mul_ps(bi,sin));
+               __m128 v2=_mm_sub_ps(_mm_mul_ps(br,sin),_mm_mul_ps(bi,cos));
+               br=_mm_add_ps(ar,v1);
+               ar=_mm_sub_ps(ar,v1);
+               bi=_mm_sub_ps(ai,v2);
+               ai=_mm_add_ps(ai,v2);
+               _mm_storeu_ps(A+c,ar);
+               _mm_storeu_ps(A+c+Channels,ai);
+               _mm_storeu_ps(B+c,br);
+               _mm_storeu_ps(B+c+Channels,bi);
+            }
+         }
+      }
+   }
+}
+
+/*
+*  AVX for 4 channels: One vector holds the real parts of a complex value
+*  of all channels in the lower and the imaginary parts in the upper half,
+*  so with W = B*cos + swap(B)*(sin,-sin) = (v1,-v2) it is B = A + W; A = A - W
+*/
+FFT_TARGET("avx2") static void BatchStages4AVX(fft_type *buffer,HFFT h,int ButterfliesPerGroup)
+{
+   const __m256 sign=_mm256_set_ps(-0.f,-0.f,-0.f,-0.f,0.f,0.f,0.f,0.f);
+   fft_type *endptr1=buffer+h->Points*8;
+
+   for(;ButterfliesPerGroup>0;ButterfliesPerGroup>>=1)
+   {
+      fft_type *sptr=h->SinTable;
+      for(fft_type *A=buffer;A<endptr1;A+=ButterfliesPerGroup*16,sptr+=2)
+      {
+         fft_type *B=A+ButterfliesPerGroup*8;
+         const __m256 sin=_mm256_xor_ps(_mm256_set1_ps(sptr[0]),sign);
+         const __m256 cos=_mm256_set1_ps(sptr[1]);
+         for(int i=0;i<ButterfliesPerGroup*8;i+=8)
+         {
+            __m256 a=_mm256_loadu_ps(A+i);
+            __m256 b=_mm256_loadu_ps(B+i);
+            __m256 w=_mm256_add_ps(_mm256_mul_ps(b,cos),_mm256_mul_ps(_mm256_permute2f128_ps(b,b,1),sin));
+            b=_mm256_add_ps(a,w);
+            a=_mm256_sub_ps(a,w);
+            _mm256_storeu_ps(A+i,a);
+            _mm256_storeu_ps(B+i,b);
+         }
+      }
+   }
+}
+
+/* Post-processing of the batched RealFFTf (see RealFFTfStages) */
+FFT_TARGET("sse2") static void BatchMassageSSE(fft_type *buffer,HFFT h,int Channels)
+{
+   const __m128 half=_mm_set1_ps(0.5f);
+   const __m128 signMask=_mm_set1_ps(-0.f);
+   int *br1=h->BitReversed+1;
+   int *br2=h->BitReversed+h->Points-1;
+   int c;
+
+   /* Massage output to get the output for a real input sequence. */
+   for(;br1<br2;br1++,br2--)
+   {
+      const __m128 sin=_mm_set1_ps(h->SinTable[*br1]);
+      const __m128 cos=_mm_set1_ps(h->SinTable[*br1+1]);
+      fft_type *A=buffer+*br1*Channels;
+      fft_type *B=buffer+*br2*Channels;
+      for(c=0;c<Channels;c+=4)
+      {
+         __m128 ar=_mm_loadu_ps(A+c),ai=_mm_loadu_ps(A+c+Channels);
+         __m128 br=_mm_loadu_ps(B+c),bi=_mm_loadu_ps(B+c+Channels);
+         __m128 HRminus=_mm_sub_ps(ar,br);
+         __m128 HRplus=_mm_add_ps(HRminus,_mm_add_ps(br,br));
+         __m128 HIminus=_mm_sub_ps(ai,bi);
+         __m128 HIplus=_mm_add_ps(HIminus,_mm_add_ps(bi,bi));
+         __m128 v1=_mm_sub_ps(_mm_mul_ps(sin,HRminus),_mm_mul_ps(cos,HIplus));
+         __m128 v2=_mm_add_ps(_mm_mul_ps(cos,HRminus),_mm_mul_ps(sin,HIplus));
+         ar=_mm_mul_ps(_mm_add_ps(HRplus,v1),half);
+         ai=_mm_mul_ps(_mm_add_ps(HIminus,v2),half);
+         _mm_storeu_ps(A+c,ar);
+         _mm_storeu_ps(B+c,_mm_sub_ps(ar,v1));
+         _mm_storeu_ps(A+c+Channels,ai);
+         _mm_storeu_ps(B+c+Channels,_mm_sub_ps(ai,HIminus));
+      }
+   }
+   /* Handle the center bin (just need a conjugate) */
+   fft_type *A=buffer+(*br1+1)*Channels;
+   for(c=0;c<Channels;c+=4)
+      _mm_storeu_ps(A+c,_mm_xor_ps(_mm_loadu_ps(A+c),signMask));
+   /* Handle DC and Fs/2 bins separately */
+   /* Put the Fs/2 value into the imaginary part of the DC bin */
+   for(c=0;c<Channels;c+=4)
+   {
+      __m128 dc=_mm_loadu_ps(buffer+c),fs2=_mm_loadu_ps(buffer+c+Channels);
+      _mm_storeu_ps(buffer+c,_mm_add_ps(dc,fs2));
+      _mm_storeu_ps(buffer+c+Channels,_mm_sub_ps(dc,fs2));
+   }
+}
+
+static bool Batch48x(fft_type *buffer,HFFT h,int Channels,bool ZeroPadded)
+{
+   ESimdLevel level=GetSimdLevel();
+   int ButterfliesPerGroup=h->Points/2;
+   /* Without SimdTwiddles the single transforms are scalar, the results must stay the same */
+   if(level==SIMD_NONE || Channels<4 || Channels%4!=0 || h->SimdTwiddles==NULL)
+      return false;
+   if(ZeroPadded)
+   {
+      /* See RealFFTfZeroPadded */
+      memcpy(buffer+h->Points*Channels,buffer,h->Points*Channels*sizeof(fft_type));
+      ButterfliesPerGroup>>=1;
+   }
+   if(level>=SIMD_AVX2 && Channels==4)
+      BatchStages4AVX(buffer,h,ButterfliesPerGroup);
+   else
+      BatchStagesSSE(buffer,h,Channels,ButterfliesPerGroup);
+   BatchMassageSSE(buffer,h,Channels);
+   return true;
+}
+
+static bool Stages48x(fft_type *buffer,HFFT h,int ButterfliesPerGroup,bool inverse)
+{
+   ESimdLevel level=GetSimdLevel();
+   if(level==SIMD_NONE || h->SimdTwiddles==NULL || ButterfliesPerGroup<2)
+      return false;
+   bool avx=level>=SIMD_AVX2;
+   /* An odd number of stages before the last two needs one radix-2 stage */
+   int stages=0;
+   for(int b=ButterfliesPerGroup;b>2;b>>=1)
+      stages++;
+   if(stages%2)
+   {
+      if(avx)
+         Radix2StageAVX(buffer,h,ButterfliesPerGroup,inverse);
+      else
+         Radix2StageSSE(buffer,h,ButterfliesPerGroup,inverse);
+      ButterfliesPerGroup>>=1;
+   }
+   for(;ButterfliesPerGroup>2;ButterfliesPerGroup>>=2)
+   {
+      if(avx)
+         Radix4StagesAVX(buffer,h,ButterfliesPerGroup,inverse);
+      else
+         Radix4StagesSSE(buffer,h,ButterfliesPerGroup,inverse);
+   }
+   if(avx)
+      LastStagesAVX(buffer,h,inverse);
+   else
+      LastStagesSSE(buffer,h,inverse);
+   return true;
+}
+
+#else
+
+static bool Stages48x(fft_type *,HFFT,int,bool)
+{
+   return false;
+}
+
+static bool Batch48x(fft_type *,HFFT,int,bool)
+{
+   return false;
+}
+
+#endif
+
+bool RealFFTfStages48x(fft_type *buffer,HFFT h,int ButterfliesPerGroup)
+{
+   return Stages48x(buffer,h,ButterfliesPerGroup,false);
+}
+
+bool InverseRealFFTfStages48x(fft_type *buffer,HFFT h)
+{
+   return Stages48x(buffer,h,h->Points/2,true);
+}
+
+bool RealFFTfBatch48x(fft_type *buffer,HFFT h,int Channels,bool ZeroPadded)
+{
+   return Batch48x(buffer,h,Channels,ZeroPadded);
+}
\ No newline at end of file
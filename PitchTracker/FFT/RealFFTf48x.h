@@ -0,0 +1,25 @@
+#ifndef __realfftf48x_h
+#define __realfftf48x_h
+
+/*
+*  Butterfly stages of RealFFTf and InverseRealFFTf processing 4 (SSE) or
+*  8 (AVX) floats at once, two stages per pass. The results equal those of
+*  the scalar loops up to float rounding.
+*  Return false if the CPU (or the FFT size, less than 8 points) is not
+*  supported, the caller has to run the scalar loops then.
+*/
+bool RealFFTfStages48x(fft_type *buffer,HFFT h,int ButterfliesPerGroup);
+bool InverseRealFFTfStages48x(fft_type *buffer,HFFT h);
+
+/*
+*  RealFFTf (or RealFFTfZeroPadded) of Channels transforms at once, one per
+*  SIMD lane. Channels must be a multiple of 4, value i of channel c is
+*  buffer[i*Channels+c] (in and out, the output is bit reversed like the one
+*  of RealFFTf), so buffer holds h->Points*2*Channels values.
+*  The results are identical to those of RealFFTf for each channel (if that
+*  uses RealFFTfStages48x).
+*  Returns false without touching buffer if not supported.
+*/
+bool RealFFTfBatch48x(fft_type *buffer,HFFT h,int Channels,bool ZeroPadded);
+
+#endif
\ No newline at end of file
@@ -1,20 +1,18 @@
 #include "Helper.h"
+#include "SimdKernels.h"
 #include <stdlib.h>
 #include <cmath>
 
 float* short2FloatArray(short* in, size_t len){
-	const float maxShort = 32767.0f;
-
 	float* result = static_cast<float*>(malloc(len * sizeof(float)));
-	float* curOut = result;
-	for(size_t i=0; i<len; i++){
-		*curOut = *in / maxShort;
-		curOut++;
-		in++;
-	}
+	short2Float(in, result, len);
 	return result;
 }
 
+void short2Float(short const* in, float* out, size_t len){
+	SimdShort2Float(in, out, len);
+}
+
 double* short2DoubleArray(short* in, size_t len, bool scale){
 	const double maxShort = 32767.0;
 
@@ -2,6 +2,8 @@
 #include <stddef.h>
 float* short2FloatArray(short* in, size_t len);
 double* short2DoubleArray(short* in, size_t len, bool scale = true);
+/** Convert len signed 16 bit samples to floats scaled to [-1, 1] into out (no allocation, vectorized where available) **/
+void short2Float(short const* in, float* out, size_t len);
 void freeFloatArray(float* floats);
 void freeDoubleArray(double* floats);
 double FreqToNote(double freq);
@@ -0,0 +1,54 @@
+#include "PassthroughMixer.h"
+#include "performous/pitch.hh"
+#include <algorithm>
+
+std::mutex PassthroughMixer::_MixersMutex;
+std::vector<PassthroughMixer*> PassthroughMixer::_Mixers;
+
+PassthroughMixer::PassthroughMixer(){
+	std::lock_guard<std::mutex> lock(_MixersMutex);
+	_Mixers.push_back(this);
+}
+
+PassthroughMixer::~PassthroughMixer(){
+	std::lock_guard<std::mutex> lock(_MixersMutex);
+	_Mixers.erase(std::remove(_Mixers.begin(), _Mixers.end(), this), _Mixers.end());
+}
+
+void PassthroughMixer::SetAnalyzer(Analyzer* analyzer, float gain, float pan){
+	pan = std::max(-1.f, std::min(1.f, pan));
+	// Balance: The center keeps the full level on both sides
+	SChannel channel = {analyzer, gain * std::min(1.f, 1.f - pan), gain * std::min(1.f, 1.f + pan)};
+	std::lock_guard<std::mutex> lock(_Mutex);
+	for(SChannel& cur : _Channels){
+		if(cur.analyzer == analyzer){
+			cur = channel;
+			return;
+		}
+	}
+	_Channels.push_back(channel);
+}
+
+void PassthroughMixer::RemoveAnalyzer(Analyzer* analyzer){
+	std::lock_guard<std::mutex> lock(_Mutex);
+	_Channels.erase(std::remove_if(_Channels.begin(), _Channels.end(), [analyzer](const SChannel& cur){ return cur.analyzer == analyzer; }), _Channels.end());
+}
+
+void PassthroughMixer::RemoveFromAll(Analyzer* analyzer){
+	std::lock_guard<std::mutex> lock(_MixersMutex);
+	for(PassthroughMixer* mixer : _Mixers)
+		mixer->RemoveAnalyzer(analyzer);
+}
+
+int PassthroughMixer::Mix(float* begin, float* end, double rate){
+	// The audio callback must not wait: Skip this buffer while the settings are changed (the lock is only held shortly)
+	std::unique_lock<std::mutex> lock(_Mutex, std::try_to_lock);
+	if(!lock.owns_lock())
+		return 0;
+	int mixed = 0;
+	for(const SChannel& channel : _Channels){
+		if(channel.analyzer->output(begin, end, rate, channel.gainLeft, channel.gainRight))
+			mixed++;
+	}
+	return mixed;
+}
\ No newline at end of file
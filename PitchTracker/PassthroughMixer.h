@@ -0,0 +1,37 @@
+#pragma once
+#include <mutex>
+#include <vector>
+
+class Analyzer;
+
+// Mixes the mic pass-through of several analyzers with individual gain and pan into one stereo buffer,
+// so the playback callback needs a single call for all mics.
+class PassthroughMixer{
+public:
+	PassthroughMixer();
+	~PassthroughMixer();
+	/** Add an analyzer or change its settings if it was added already. gain scales the signal, pan goes from -1 (left) to 1 (right).
+	    The analyzer is not owned by the mixer: Remove it (or call RemoveFromAll) before freeing it. **/
+	void SetAnalyzer(Analyzer* analyzer, float gain, float pan);
+	/** Remove the analyzer. Waits for a Mix in progress, so the analyzer may be freed afterwards. **/
+	void RemoveAnalyzer(Analyzer* analyzer);
+	/** Add the pass-through of all analyzers to the interleaved stereo samples in [begin, end) that are played with rate.
+	    Never blocks: If the settings are just being changed, nothing is added for this call (silence).
+	    Returns the number of analyzers that had enough data. **/
+	int Mix(float* begin, float* end, double rate);
+	/** Remove the analyzer from all mixers (call it before freeing the analyzer) **/
+	static void RemoveFromAll(Analyzer* analyzer);
+
+private:
+	struct SChannel{
+		Analyzer* analyzer;
+		float gainLeft;
+		float gainRight;
+	};
+
+	std::mutex _Mutex; // Only held shortly for changes of the settings, Mix does not wait for it
+	std::vector<SChannel> _Channels;
+
+	static std::mutex _MixersMutex;
+	static std::vector<PassthroughMixer*> _Mixers; // All existing mixers, for RemoveFromAll
+};
\ No newline at end of file
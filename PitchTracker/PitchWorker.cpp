@@ -0,0 +1,223 @@
+#include "PitchWorker.h"
+#include "ptAKF.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+void NoteSnapshot::Resize(int toneCount){
+	_Weights.reset(new std::atomic<float>[toneCount]);
+	for(int i = 0; i < toneCount; i++)
+		_Weights[i].store(0.f, std::memory_order_relaxed);
+	_ToneCount = toneCount;
+}
+
+void NoteSnapshot::Publish(int note, int lastTone, float maxVolume, const float* weights){
+	unsigned version = _Version.load(std::memory_order_relaxed);
+	_Version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); // Readers must not see new values with the old version
+	_Note.store(note, std::memory_order_relaxed);
+	_LastTone.store(lastTone, std::memory_order_relaxed);
+	_MaxVolume.store(maxVolume, std::memory_order_relaxed);
+	for(int i = 0; i < _ToneCount; i++)
+		_Weights[i].store(weights[i], std::memory_order_relaxed);
+	_Version.store(version + 2, std::memory_order_release);
+}
+
+bool NoteSnapshot::Read(unsigned* version, int* note, int* lastTone, float* maxVolume, float* weights) const{
+	for(int i = 0; i < _MaxReadTries; i++){
+		if(i > 0)
+			std::this_thread::yield();
+		unsigned cur = _Version.load(std::memory_order_acquire);
+		if(cur & 1)
+			continue;
+		*note = _Note.load(std::memory_order_relaxed);
+		*lastTone = _LastTone.load(std::memory_order_relaxed);
+		*maxVolume = _MaxVolume.load(std::memory_order_relaxed);
+		for(int j = 0; j < _ToneCount; j++)
+			weights[j] = _Weights[j].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire); // Load the version again only after the values
+		if(_Version.load(std::memory_order_relaxed) == cur){
+			*version = cur;
+			return true;
+		}
+	}
+	return false;
+}
+
+PitchWorker::PitchWorker(unsigned threadCount){
+	_BatchRunning = 0;
+	threadCount = std::max(threadCount, 1u);
+	for(unsigned i = 0; i < threadCount; i++){
+		std::unique_ptr<SThread> thread(new SThread());
+		thread->signaled = false;
+		thread->stop = false;
+		thread->batchTrackers = NULL;
+		thread->batchCount = 0;
+		thread->batchResults = NULL;
+		thread->thread = std::thread(&PitchWorker::_Run, this, thread.get());
+		_Threads.push_back(std::move(thread));
+	}
+}
+
+PitchWorker::~PitchWorker(){
+	// Detach the trackers first, input may notify the threads until no notification uses this worker anymore
+	for(auto& thread : _Threads){
+		std::lock_guard<std::mutex> lock(thread->mutex);
+		for(PtAKF* tracker : thread->trackers)
+			tracker->_DetachWorker();
+		thread->trackers.clear();
+	}
+	for(auto& thread : _Threads){
+		{
+			std::lock_guard<std::mutex> lock(thread->wakeMutex);
+			thread->stop = true;
+		}
+		thread->wake.notify_one();
+		thread->thread.join();
+	}
+}
+
+bool PitchWorker::Add(PtAKF* tracker){
+	if(tracker->_Worker.load(std::memory_order_acquire))
+		return false;
+	unsigned best = 0;
+	size_t bestCount = 0;
+	for(unsigned i = 0; i < _Threads.size(); i++){
+		std::lock_guard<std::mutex> lock(_Threads[i]->mutex);
+		if(i == 0 || _Threads[i]->trackers.size() < bestCount){
+			best = i;
+			bestCount = _Threads[i]->trackers.size();
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(_Threads[best]->mutex);
+		tracker->_WorkerThread = best;
+		tracker->_SnapshotSeen = tracker->_Snapshot.GetVersion();
+		tracker->_SnapshotLastTone = tracker->_LastTones[tracker->_LastToneIndex];
+		tracker->_SnapshotMaxVolume = tracker->_LastMaxVol;
+		// Input that is already there has to be analyzed as well
+		tracker->_InputPending.store(true, std::memory_order_relaxed);
+		_Threads[best]->trackers.push_back(tracker);
+		tracker->_Worker.store(this, std::memory_order_release);
+	}
+	_Notify(best);
+	return true;
+}
+
+void PitchWorker::Remove(PtAKF* tracker){
+	if(tracker->_Worker.load(std::memory_order_acquire) != this)
+		return;
+	SThread* thread = _Threads[tracker->_WorkerThread].get();
+	std::lock_guard<std::mutex> lock(thread->mutex);
+	thread->trackers.erase(std::remove(thread->trackers.begin(), thread->trackers.end(), tracker), thread->trackers.end());
+	tracker->_DetachWorker();
+}
+
+void PitchWorker::AnalyzeBatch(PtAKF* const* trackers, int count, SNoteResult* results){
+	// Range 0 is analyzed by the calling thread, range r by thread r - 1
+	int rangeCt = std::min(count, static_cast<int>(_Threads.size()) + 1);
+	if(rangeCt <= 1){
+		PtAKF::AnalyzeToResults(trackers, count, results);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_BatchMutex);
+		_BatchRunning = rangeCt - 1;
+	}
+	for(int r = 1; r < rangeCt; r++){
+		int first = count * r / rangeCt;
+		int last = count * (r + 1) / rangeCt;
+		SThread* thread = _Threads[r - 1].get();
+		{
+			std::lock_guard<std::mutex> lock(thread->wakeMutex);
+			thread->batchTrackers = trackers + first;
+			thread->batchCount = last - first;
+			thread->batchResults = results + first;
+		}
+		thread->wake.notify_one();
+	}
+	PtAKF::AnalyzeToResults(trackers, count / rangeCt, results);
+	std::unique_lock<std::mutex> lock(_BatchMutex);
+	_BatchDone.wait(lock, [this]{return _BatchRunning == 0;});
+}
+
+bool PitchWorker::SetAffinity(unsigned firstCpu){
+#ifdef __linux__
+	bool ok = true;
+	for(unsigned i = 0; i < _Threads.size(); i++){
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(firstCpu + i, &cpus);
+		if(pthread_setaffinity_np(_Threads[i]->thread.native_handle(), sizeof(cpus), &cpus) != 0)
+			ok = false;
+	}
+	return ok;
+#else
+	(void)firstCpu;
+	return false;
+#endif
+}
+
+bool PitchWorker::SetRealtimePriority(int priority){
+#ifdef __linux__
+	sched_param param;
+	param.sched_priority = priority;
+	bool ok = true;
+	for(auto& thread : _Threads){
+		if(pthread_setschedparam(thread->thread.native_handle(), SCHED_FIFO, &param) != 0)
+			ok = false;
+	}
+	return ok;
+#else
+	(void)priority;
+	return false;
+#endif
+}
+
+void PitchWorker::_Notify(unsigned thread){
+	SThread* cur = _Threads[thread].get();
+	{
+		std::lock_guard<std::mutex> lock(cur->wakeMutex);
+		cur->signaled = true;
+	}
+	cur->wake.notify_one();
+}
+
+void PitchWorker::_Run(SThread* thread){
+	for(;;){
+		bool signaled;
+		PtAKF* const* batchTrackers;
+		int batchCount;
+		SNoteResult* batchResults;
+		{
+			std::unique_lock<std::mutex> lock(thread->wakeMutex);
+			thread->wake.wait(lock, [thread]{return thread->signaled || thread->stop || thread->batchTrackers;});
+			if(thread->stop)
+				return;
+			signaled = thread->signaled;
+			thread->signaled = false;
+			batchTrackers = thread->batchTrackers;
+			batchCount = thread->batchCount;
+			batchResults = thread->batchResults;
+			thread->batchTrackers = NULL;
+		}
+		if(batchTrackers){
+			PtAKF::AnalyzeToResults(batchTrackers, batchCount, batchResults);
+			{
+				std::lock_guard<std::mutex> lock(_BatchMutex);
+				_BatchRunning--;
+			}
+			_BatchDone.notify_one();
+		}
+		if(!signaled)
+			continue;
+		std::lock_guard<std::mutex> lock(thread->mutex);
+		for(PtAKF* tracker : thread->trackers){
+			if(tracker->_InputPending.exchange(false, std::memory_order_acquire))
+				tracker->_AnalyzeInBackground();
+		}
+	}
+}
\ No newline at end of file
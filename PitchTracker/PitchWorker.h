@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PtAKF;
+struct SNoteResult;
+
+/** Latest result of a tracker that is analyzed in the background. One thread publishes, others read it without locking (seqlock):
+    A reader copies it and retries a few times if the version changed meanwhile, so reading never waits for an analysis. **/
+class NoteSnapshot{
+public:
+	NoteSnapshot(): _Version(0), _Note(-1), _LastTone(-1), _MaxVolume(0.f), _ToneCount(0) {}
+	/** Set the number of weights. Not thread-safe, only call it before the snapshot is used. **/
+	void Resize(int toneCount);
+	void Publish(int note, int lastTone, float maxVolume, const float* weights);
+	/** Copy the snapshot and store its version (even, 0 = nothing published yet). Returns false if the writer changed it during
+	    every try (e.g. it was preempted while publishing), the copy is inconsistent then. **/
+	bool Read(unsigned* version, int* note, int* lastTone, float* maxVolume, float* weights) const;
+	unsigned GetVersion() const {return _Version.load(std::memory_order_acquire);}
+
+private:
+	static constexpr int _MaxReadTries = 8;
+
+	std::atomic<unsigned> _Version; // Odd while the writer is changing the values
+	std::atomic<int> _Note;
+	std::atomic<int> _LastTone;
+	std::atomic<float> _MaxVolume;
+	std::unique_ptr<std::atomic<float>[]> _Weights;
+	int _ToneCount;
+};
+
+/** Analyzes PtAKF trackers on its own threads as soon as they get input, so the thread calling GetNote only reads the latest result.
+    Every tracker is assigned to one thread (the one with the fewest trackers). Add and remove trackers on the thread that calls GetNote,
+    and not while input is delivered to them. The settings of a tracker should be changed before it is added.
+    The threads can also analyze trackers that were not added on request (AnalyzeBatch). **/
+class PitchWorker{
+public:
+	explicit PitchWorker(unsigned threadCount = 1);
+	/** Stops the threads. Trackers still added are analyzed by GetNote again, input may still be delivered to them meanwhile. **/
+	~PitchWorker();
+
+	/** Analyze the tracker in the background from now on. Returns false if it already belongs to a worker. **/
+	bool Add(PtAKF* tracker);
+	/** Stop analyzing the tracker in the background (waits for an analysis of it that is running) **/
+	void Remove(PtAKF* tracker);
+	/** PtAKF::AnalyzeToResults split into ranges that are analyzed in parallel by the threads and the calling thread.
+	    Only call it from one thread at a time. **/
+	void AnalyzeBatch(PtAKF* const* trackers, int count, SNoteResult* results);
+	/** Pin thread i to the CPU firstCpu + i. Only supported on Linux, returns false if it failed. **/
+	bool SetAffinity(unsigned firstCpu);
+	/** Run the threads with the real-time policy SCHED_FIFO and the priority (1..99). Only supported on Linux,
+	    returns false if it failed (needs CAP_SYS_NICE or a matching RLIMIT_RTPRIO). **/
+	bool SetRealtimePriority(int priority);
+	unsigned GetThreadCount(){return static_cast<unsigned>(_Threads.size());}
+
+private:
+	friend class PtAKF;
+
+	struct SThread{
+		std::thread thread;
+		std::mutex mutex; // Guards trackers, held during the analysis
+		std::vector<PtAKF*> trackers;
+		std::mutex wakeMutex; // Guards the members below, only held shortly so input never waits for an analysis
+		std::condition_variable wake;
+		bool signaled;
+		bool stop;
+		// Range of AnalyzeBatch to analyze (batchTrackers is NULL if none)
+		PtAKF* const* batchTrackers;
+		int batchCount;
+		SNoteResult* batchResults;
+	};
+
+	std::vector<std::unique_ptr<SThread>> _Threads;
+	std::mutex _BatchMutex;
+	std::condition_variable _BatchDone;
+	int _BatchRunning; // Ranges of AnalyzeBatch the threads did not finish yet
+
+	void _Run(SThread* thread);
+	/** Wake up the thread because one of its trackers got input **/
+	void _Notify(unsigned thread);
+};
\ No newline at end of file
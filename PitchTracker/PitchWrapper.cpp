@@ -3,12 +3,22 @@
 
 
 Analyzer* Analyzer_Create(unsigned step){
-    return new Analyzer(44100, "", step);
+    return Analyzer::create(44100, "", step).release();
+}
+
+Analyzer* Analyzer_CreateEx(unsigned step, double sampleRate, unsigned fftSize){
+	try{
+		return Analyzer::create(sampleRate, "", step, fftSize).release();
+	}catch(std::exception&){
+		return NULL;
+	}
 }
 
 void Analyzer_Free(Analyzer* analyzer){
-    if(analyzer)
-		delete analyzer;
+	if(!analyzer)
+		return;
+	PassthroughMixer::RemoveFromAll(analyzer);
+	delete analyzer;
 }
 
 void Analyzer_InputFloat(Analyzer* analyzer, float* data, int sampleCt){
@@ -20,17 +30,14 @@ void Analyzer_InputFloat(Analyzer* analyzer, float* data, int sampleCt){
 void Analyzer_InputShort(Analyzer* analyzer, short* data, int sampleCt){
 	if(sampleCt == 0 || !analyzer)
 		return;
-	float* dataFloat = short2FloatArray(data, sampleCt);
-	analyzer->input(dataFloat, dataFloat + sampleCt);
-	freeFloatArray(dataFloat);  
+	analyzer->inputShort(data, data + sampleCt);
 }
 
 void Analyzer_InputByte(Analyzer* analyzer, char* data, int sampleCt){
 	if(sampleCt <= 0 || !analyzer)
 		return;
-	float* dataFloat = short2FloatArray(static_cast<short*>(static_cast<void*>(data)), sampleCt);
-	analyzer->input(dataFloat, dataFloat + sampleCt);
-	freeFloatArray(dataFloat);
+	short* dataShort = static_cast<short*>(static_cast<void*>(data));
+	analyzer->inputShort(dataShort, dataShort + sampleCt);
 }
 
 void Analyzer_Process(Analyzer* analyzer){
@@ -39,6 +46,12 @@ void Analyzer_Process(Analyzer* analyzer){
     analyzer->process();
 }
 
+void Analyzer_SetBacklogPolicy(Analyzer* analyzer, unsigned maxWindows, unsigned maxMicros){
+	if(!analyzer)
+		return;
+	analyzer->setBacklogPolicy(maxWindows, maxMicros);
+}
+
 float Analyzer_GetPeak(Analyzer* analyzer){
 	if(!analyzer)
 		return -999;
@@ -58,10 +71,45 @@ bool Analyzer_OutputFloat(Analyzer* analyzer, float* data, int sampleCt, float r
     return analyzer->output(data, data + sampleCt, rate);
 }
 
+PassthroughMixer* PassthroughMixer_Create(){
+	return new PassthroughMixer();
+}
+
+void PassthroughMixer_Free(PassthroughMixer* mixer){
+	if(mixer)
+		delete mixer;
+}
+
+void PassthroughMixer_SetAnalyzer(PassthroughMixer* mixer, Analyzer* analyzer, float gain, float pan){
+	if(!mixer || !analyzer)
+		return;
+	mixer->SetAnalyzer(analyzer, gain, pan);
+}
+
+void PassthroughMixer_RemoveAnalyzer(PassthroughMixer* mixer, Analyzer* analyzer){
+	if(!mixer)
+		return;
+	mixer->RemoveAnalyzer(analyzer);
+}
+
+int PassthroughMixer_Mix(PassthroughMixer* mixer, float* data, int sampleCt, float rate){
+	if(!mixer || sampleCt <= 0)
+		return 0;
+	return mixer->Mix(data, data + sampleCt, rate);
+}
+
 PtAKF* PtAKF_Create(unsigned step){
 	return new PtAKF(step);
 }
 
+PtAKF* PtAKF_CreateEx(unsigned step, double sampleRate, int minHalfTone, int maxHalfTone, unsigned sampleCt){
+	try{
+		return new PtAKF(step, sampleRate, minHalfTone, maxHalfTone, sampleCt);
+	}catch(std::exception&){
+		return NULL;
+	}
+}
+
 void PtAKF_Free(PtAKF* analyzer){
 	if(analyzer)
 		delete analyzer;
@@ -71,6 +119,12 @@ int PtAKF_GetNumHalfTones(){
 	return PtAKF::GetNumHalfTones();
 }
 
+int PtAKF_GetToneCount(PtAKF* analyzer){
+	if(!analyzer)
+		return 0;
+	return analyzer->GetToneCount();
+}
+
 void PtAKF_SetVolumeThreshold(PtAKF* analyzer, float threshold){
 	if(!analyzer)
 		return;
@@ -83,15 +137,35 @@ float PtAKF_GetVolumeThreshold(PtAKF* analyzer){
 	return analyzer->GetVolumeThreshold();
 }
 
+void PtAKF_SetPeakGuidedSearch(PtAKF* analyzer, bool enabled){
+	if(!analyzer)
+		return;
+	analyzer->SetPeakGuidedSearch(enabled);
+}
+
+void PtAKF_SetSlidingWindow(PtAKF* analyzer, bool enabled){
+	if(!analyzer)
+		return;
+	analyzer->SetSlidingWindow(enabled);
+}
+
+void PtAKF_SetBacklogPolicy(PtAKF* analyzer, unsigned maxWindows, unsigned maxMicros){
+	if(!analyzer)
+		return;
+	analyzer->SetBacklogPolicy(maxWindows, maxMicros);
+}
+
 void PtAKF_InputByte(PtAKF* analyzer, char* data, int sampleCt){
 	if(sampleCt <= 0 || !analyzer)
 		return;
-	//short* dataShort = static_cast<short*>(static_cast<void*>(data));
-	float* dataFloat = short2FloatArray(static_cast<short*>(static_cast<void*>(data)), sampleCt);
-	analyzer->input(dataFloat, dataFloat + sampleCt);
-	freeFloatArray(dataFloat);
+	short* dataShort = static_cast<short*>(static_cast<void*>(data));
+	analyzer->inputShort(dataShort, dataShort + sampleCt);
+}
 
-	//analyzer->input(dataShort, dataShort + sampleCt);
+bool PtAKF_InputInterleaved(PtAKF** analyzers, int channelCount, short* frames, int frameCount){
+	if(!analyzers || frameCount <= 0)
+		return false;
+	return PtAKF::InputInterleaved(analyzers, channelCount, frames, frameCount);
 }
 
 int PtAKF_GetNote(PtAKF* analyzer, float* maxVolume, float* weights){
@@ -100,6 +174,87 @@ int PtAKF_GetNote(PtAKF* analyzer, float* maxVolume, float* weights){
 	return analyzer->GetNote(maxVolume, weights);
 }
 
+void PtAKF_GetNotes(PtAKF** analyzers, int count, int* notes, float* maxVolumes, float* weights){
+	if(!analyzers || count <= 0 || !notes || !maxVolumes || !weights)
+		return;
+	for(int i = 0; i < count; i++){
+		if(analyzers[i])
+			continue;
+		// Like PtAKF_GetNote for a NULL analyzer, but for all as they are analyzed together
+		for(int j = 0; j < count; j++){
+			notes[j] = -1;
+			maxVolumes[j] = 0.f;
+		}
+		return;
+	}
+	PtAKF::GetNotes(analyzers, count, notes, maxVolumes, weights);
+}
+
+bool PtAKF_AnalyzeBatch(PtAKF** analyzers, int count, char* data, int* sampleCts, SNoteResult* results, PitchWorker* worker){
+	if(!analyzers || count <= 0 || !data || !sampleCts || !results)
+		return false;
+	// Check everything before any input is consumed. SNoteResult only holds the weights of ResultTones tones,
+	// and a tracker given twice would get both sample blocks and could be analyzed by two threads at once.
+	for(int i = 0; i < count; i++){
+		if(!analyzers[i] || analyzers[i]->GetToneCount() > SNoteResult::ResultTones)
+			return false;
+		for(int j = 0; j < i; j++){
+			if(analyzers[j] == analyzers[i])
+				return false;
+		}
+	}
+	// The sample blocks of the analyzers follow each other in data
+	short* dataShort = static_cast<short*>(static_cast<void*>(data));
+	for(int i = 0; i < count; i++){
+		if(sampleCts[i] <= 0)
+			continue;
+		analyzers[i]->inputShort(dataShort, dataShort + sampleCts[i]);
+		dataShort += sampleCts[i];
+	}
+	if(worker)
+		worker->AnalyzeBatch(analyzers, count, results);
+	else
+		PtAKF::AnalyzeToResults(analyzers, count, results);
+	return true;
+}
+
+PitchWorker* PitchWorker_Create(unsigned threadCount){
+	try{
+		return new PitchWorker(threadCount);
+	}catch(std::exception&){
+		return NULL;
+	}
+}
+
+void PitchWorker_Free(PitchWorker* worker){
+	if(worker)
+		delete worker;
+}
+
+bool PitchWorker_Add(PitchWorker* worker, PtAKF* analyzer){
+	if(!worker || !analyzer)
+		return false;
+	return worker->Add(analyzer);
+}
+
+void PitchWorker_Remove(PitchWorker* worker, PtAKF* analyzer){
+	if(!worker || !analyzer)
+		return;
+	worker->Remove(analyzer);
+}
+
+bool PitchWorker_SetAffinity(PitchWorker* worker, unsigned firstCpu){
+	if(!worker)
+		return false;
+	return worker->SetAffinity(firstCpu);
+}
+
+bool PitchWorker_SetRealtimePriority(PitchWorker* worker, int priority){
+	if(!worker)
+		return false;
+	return worker->SetRealtimePriority(priority);
+}
+
 PtDyWa* PtDyWa_Create(unsigned step){
 	return new PtDyWa(step);
 }
@@ -124,9 +279,8 @@ float PtDyWa_GetVolumeThreshold(PtDyWa* analyzer){
 void PtDyWa_InputByte(PtDyWa* analyzer, char* data, int sampleCt){
 	if(sampleCt <= 0 || !analyzer)
 		return;
-	float* dataFloat = short2FloatArray(static_cast<short*>(static_cast<void*>(data)), sampleCt);
-	analyzer->input(dataFloat, dataFloat + sampleCt);
-	freeFloatArray(dataFloat);
+	short* dataShort = static_cast<short*>(static_cast<void*>(data));
+	analyzer->inputShort(dataShort, dataShort + sampleCt);
 }
 
 double PtDyWa_FindNote(PtDyWa* analyzer, float* maxVolume){
@@ -3,6 +3,8 @@
 #include "performous/pitch.hh"
 #include "ptAKF.h"
 #include "dywapitchtrack/ptDyWa.h"
+#include "PassthroughMixer.h"
+#include "PitchWorker.h"
 
 #ifdef __linux__
 	#define DllExport extern "C"
@@ -12,22 +14,45 @@
 
 
 DllExport Analyzer* Analyzer_Create(unsigned step);
+DllExport Analyzer* Analyzer_CreateEx(unsigned step, double sampleRate, unsigned fftSize);
 DllExport void Analyzer_Free(Analyzer* analyzer);
 DllExport void Analyzer_InputFloat(Analyzer* analyzer, float* data, int sampleCt);
 DllExport void Analyzer_InputShort(Analyzer* analyzer, short* data, int sampleCt);
 DllExport void Analyzer_InputByte(Analyzer* analyzer, char* data, int sampleCt);
 DllExport void Analyzer_Process(Analyzer* analyzer);
+DllExport void Analyzer_SetBacklogPolicy(Analyzer* analyzer, unsigned maxWindows, unsigned maxMicros);
 DllExport float Analyzer_GetPeak(Analyzer* analyzer);
 DllExport double Analyzer_FindNote(Analyzer* analyzer, double minFreq, double maxFreq);
 DllExport bool Analyzer_OutputFloat(Analyzer* analyzer, float* data, int sampleCt, float rate);
 
+DllExport PassthroughMixer* PassthroughMixer_Create();
+DllExport void PassthroughMixer_Free(PassthroughMixer* mixer);
+DllExport void PassthroughMixer_SetAnalyzer(PassthroughMixer* mixer, Analyzer* analyzer, float gain, float pan);
+DllExport void PassthroughMixer_RemoveAnalyzer(PassthroughMixer* mixer, Analyzer* analyzer);
+DllExport int PassthroughMixer_Mix(PassthroughMixer* mixer, float* data, int sampleCt, float rate);
+
 DllExport PtAKF* PtAKF_Create(unsigned step);
+DllExport PtAKF* PtAKF_CreateEx(unsigned step, double sampleRate, int minHalfTone, int maxHalfTone, unsigned sampleCt);
 DllExport void PtAKF_Free(PtAKF* analyzer);
 DllExport int PtAKF_GetNumHalfTones();
+DllExport int PtAKF_GetToneCount(PtAKF* analyzer);
 DllExport void PtAKF_SetVolumeThreshold(PtAKF* analyzer, float threshold);
 DllExport float PtAKF_GetVolumeThreshold(PtAKF* analyzer);
+DllExport void PtAKF_SetPeakGuidedSearch(PtAKF* analyzer, bool enabled);
+DllExport void PtAKF_SetSlidingWindow(PtAKF* analyzer, bool enabled);
+DllExport void PtAKF_SetBacklogPolicy(PtAKF* analyzer, unsigned maxWindows, unsigned maxMicros);
 DllExport void PtAKF_InputByte(PtAKF* analyzer, char* data, int sampleCt);
+DllExport bool PtAKF_InputInterleaved(PtAKF** analyzers, int channelCount, short* frames, int frameCount);
 DllExport int PtAKF_GetNote(PtAKF* analyzer, float* maxVolume, float* weights);
+DllExport void PtAKF_GetNotes(PtAKF** analyzers, int count, int* notes, float* maxVolumes, float* weights);
+DllExport bool PtAKF_AnalyzeBatch(PtAKF** analyzers, int count, char* data, int* sampleCts, SNoteResult* results, PitchWorker* worker);
+
+DllExport PitchWorker* PitchWorker_Create(unsigned threadCount);
+DllExport void PitchWorker_Free(PitchWorker* worker);
+DllExport bool PitchWorker_Add(PitchWorker* worker, PtAKF* analyzer);
+DllExport void PitchWorker_Remove(PitchWorker* worker, PtAKF* analyzer);
+DllExport bool PitchWorker_SetAffinity(PitchWorker* worker, unsigned firstCpu);
+DllExport bool PitchWorker_SetRealtimePriority(PitchWorker* worker, int priority);
 
 DllExport PtDyWa* PtDyWa_Create(unsigned step);
 DllExport void PtDyWa_Free(PtDyWa* analyzer);
@@ -0,0 +1,817 @@
+#include "SimdKernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET(x)
+		#if(_MSC_VER >= 1911) // VS2017 15.3 knows the AVX-512 intrinsics
+			#define SIMD_HAVE_AVX512
+		#endif
+	#else
+		#include <cpuid.h>
+		// Allow the intrinsics in the functions below without compiling the whole library for that instruction set
+		#define SIMD_TARGET(x) __attribute__((target(x)))
+		#define SIMD_HAVE_AVX512
+	#endif
+#endif
+
+// Scalar reference implementations (also used for the tails of the vectorized versions)
+
+static float AbsDiffInterpScalar(const float* a, const float* b, int count, float fLow, float fHigh){
+	float accumDist = 0;
+	for(int i = 0; i < count; i++){
+		float diff = a[i] - (b[i] * fLow + b[i + 1] * fHigh);
+		accumDist += diff >= 0 ? diff : -diff;
+	}
+	return accumDist;
+}
+
+static float DotInterpScalar(const float* a, const float* b, int count, float fLow, float fHigh){
+	float accumDist = 0;
+	for(int i = 0; i < count; i++)
+		accumDist += a[i] * (b[i] * fLow + b[i + 1] * fHigh);
+	return accumDist;
+}
+
+static float DotScalar(const float* a, const float* b, int count){
+	float accum = 0;
+	for(int i = 0; i < count; i++)
+		accum += a[i] * b[i];
+	return accum;
+}
+
+static void Dot5Scalar(const float* a, size_t aStride, const float* b, int count, float sums[5]){
+	for(int k = 0; k < 5; k++)
+		sums[k] = DotScalar(a + k * aStride, b, count);
+}
+
+static void Short2FloatScalar(const short* in, float* out, size_t len){
+	const float maxShort = 32767.0f;
+	for(size_t i = 0; i < len; i++)
+		out[i] = in[i] / maxShort;
+}
+
+static void DeinterleaveShort2FloatScalar(const short* in, int channels, float* const* out, size_t frames){
+	const float maxShort = 32767.0f;
+	for(int c = 0; c < channels; c++){
+		if(!out[c])
+			continue;
+		for(size_t i = 0; i < frames; i++)
+			out[c][i] = in[i * channels + c] / maxShort;
+	}
+}
+
+static double Interpolate4Scalar(const float* in, const float* table, int phases, double pos, double step, float* out, int count){
+	for(int i = 0; i < count; i++){
+		int k = static_cast<int>(pos);
+		double phase = (pos - k) * phases;
+		int r = static_cast<int>(phase);
+		float f = static_cast<float>(phase - r);
+		const float* c0 = table + 4 * r;
+		const float* c1 = c0 + 4;
+		float sum = 0;
+		for(int t = 0; t < 4; t++)
+			sum += in[k + t] * (c0[t] + f * (c1[t] - c0[t]));
+		out[i] = sum;
+		pos += step;
+	}
+	return pos;
+}
+
+static void MixMonoToStereoScalar(const float* in, float* out, size_t count, float gainLeft, float gainRight){
+	for(size_t i = 0; i < count; i++){
+		out[2 * i] += in[i] * gainLeft;
+		out[2 * i + 1] += in[i] * gainRight;
+	}
+}
+
+static float SumMinMaxScalar(const float* in, size_t count, float* minValue, float* maxValue){
+	float sum = 0, minV = *minValue, maxV = *maxValue;
+	for(size_t i = 0; i < count; i++){
+		sum += in[i];
+		if(in[i] < minV) minV = in[i];
+		if(in[i] > maxV) maxV = in[i];
+	}
+	*minValue = minV;
+	*maxValue = maxV;
+	return sum;
+}
+
+static void HalveScalar(const float* in, float* out, size_t count){
+	for(size_t i = 0; i < count; i++)
+		out[i] = (in[2 * i] + in[2 * i + 1]) * 0.5f;
+}
+
+// Constants of the spectrum kernels. All implementations do exactly the same float operations, so their results are identical.
+static const float SpecPi = 3.14159265f;
+static const float SpecHalfPi = 1.57079633f;
+static const float SpecInvPi = 0.318309886f;
+static const float SpecDbPerNeper = 4.34294482f; // 10 / ln(10)
+// Minimax approximation of atan(a) / a on [0, 1] in a^2
+static const float AtanC0 = 0.99997726f, AtanC1 = -0.33262347f, AtanC2 = 0.19354346f, AtanC3 = -0.11643287f, AtanC4 = 0.05265332f, AtanC5 = -0.01172120f;
+// Natural logarithm from the Cephes library: ln(1 + x) for 1 + x in [sqrt(0.5), sqrt(2))
+static const float LnSqrtHalf = 0.707106781f;
+static const float LnP0 = 7.0376836292E-2f, LnP1 = -1.1514610310E-1f, LnP2 = 1.1676998740E-1f, LnP3 = -1.2420140846E-1f, LnP4 = 1.4249322787E-1f,
+	LnP5 = -1.6668057665E-1f, LnP6 = 2.0000714765E-1f, LnP7 = -2.4999993993E-1f, LnP8 = 3.3333331174E-1f;
+static const float LnQ1 = -2.12194440e-4f, LnQ2 = 0.693359375f;
+
+static inline float FastAtan2(float y, float x){
+	float ax = std::fabs(x), ay = std::fabs(y);
+	float a = std::min(ax, ay) / std::max(std::max(ax, ay), FLT_MIN);
+	float s = a * a;
+	float r = a * (AtanC0 + s * (AtanC1 + s * (AtanC2 + s * (AtanC3 + s * (AtanC4 + s * AtanC5)))));
+	if(ay > ax)
+		r = SpecHalfPi - r;
+	if(x < 0)
+		r = SpecPi - r;
+	return y < 0 ? -r : r;
+}
+
+// Only valid for positive normal numbers
+static inline float FastLn(float x){
+	unsigned bits;
+	memcpy(&bits, &x, sizeof(bits));
+	int e = static_cast<int>(bits >> 23) - 126;
+	bits = (bits & 0x807FFFFFu) | 0x3F000000u; // Mantissa in [0.5, 1)
+	float m;
+	memcpy(&m, &bits, sizeof(m));
+	if(m < LnSqrtHalf){
+		e--;
+		m = m + m - 1.0f;
+	}else
+		m = m - 1.0f;
+	float fe = static_cast<float>(e);
+	float z = m * m;
+	float y = (((((((((LnP0 * m + LnP1) * m + LnP2) * m + LnP3) * m + LnP4) * m + LnP5) * m + LnP6) * m + LnP7) * m + LnP8) * m) * z;
+	y = y + fe * LnQ1;
+	y = y - 0.5f * z;
+	return (m + y) + fe * LnQ2;
+}
+
+static void SpectrumScalar(const float* spectrum, float* phase, const float* expectedPhase, int firstBin, int count, float phaseStep, float freqPerBin, float minPower, float dbOffset, float* freq, float* db){
+	const float invPhaseStep = 1.0f / phaseStep;
+	for(int i = 0; i < count; i++){
+		float re = spectrum[2 * i], im = spectrum[2 * i + 1];
+		float p = FastAtan2(im, re);
+		float delta = p - phase[i] - expectedPhase[i];
+		phase[i] = p;
+		delta = delta - SpecPi * std::nearbyint(delta * SpecInvPi);
+		float f = (static_cast<float>(firstBin + i) + delta * invPhaseStep) * freqPerBin;
+		float power = re * re + im * im;
+		if(f > 1.0f && power > minPower){
+			freq[i] = f;
+			db[i] = FastLn(power) * SpecDbPerNeper + dbOffset;
+		}else{
+			freq[i] = 0.0f;
+			db[i] = -std::numeric_limits<float>::infinity();
+		}
+	}
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2") static inline float HorizontalSum(__m128 v){
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+// SSE2
+
+SIMD_TARGET("sse2") static float AbsDiffInterpSSE2(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m128 low = _mm_set1_ps(fLow), high = _mm_set1_ps(fHigh);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m128 t0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i), low), _mm_mul_ps(_mm_loadu_ps(b + i + 1), high));
+		__m128 t1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i + 4), low), _mm_mul_ps(_mm_loadu_ps(b + i + 5), high));
+		acc0 = _mm_add_ps(acc0, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i), t0), absMask));
+		acc1 = _mm_add_ps(acc1, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i + 4), t1), absMask));
+	}
+	return HorizontalSum(_mm_add_ps(acc0, acc1)) + AbsDiffInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("sse2") static float DotInterpSSE2(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m128 low = _mm_set1_ps(fLow), high = _mm_set1_ps(fHigh);
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m128 t0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i), low), _mm_mul_ps(_mm_loadu_ps(b + i + 1), high));
+		__m128 t1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i + 4), low), _mm_mul_ps(_mm_loadu_ps(b + i + 5), high));
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), t0));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), t1));
+	}
+	return HorizontalSum(_mm_add_ps(acc0, acc1)) + DotInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("sse2") static float DotSSE2(const float* a, const float* b, int count){
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= count; i += 8){
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	return HorizontalSum(_mm_add_ps(acc0, acc1)) + DotScalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("sse2") static void Dot5SSE2(const float* a, size_t aStride, const float* b, int count, float sums[5]){
+	__m128 acc[5];
+	for(int k = 0; k < 5; k++)
+		acc[k] = _mm_setzero_ps();
+	int i = 0;
+	for(; i + 4 <= count; i += 4){
+		__m128 xb = _mm_loadu_ps(b + i);
+		for(int k = 0; k < 5; k++)
+			acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(_mm_loadu_ps(a + k * aStride + i), xb));
+	}
+	for(int k = 0; k < 5; k++)
+		sums[k] = HorizontalSum(acc[k]) + DotScalar(a + k * aStride + i, b + i, count - i);
+}
+
+SIMD_TARGET("sse2") static void Short2FloatSSE2(const short* in, float* out, size_t len){
+	// Divide instead of multiplying by the reciprocal so the result is bit-identical to the scalar conversion
+	const __m128 maxShort = _mm_set1_ps(32767.0f);
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8){
+		__m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		// Sign extend to 32 bit by moving the 16 bit values to the upper half and shifting back arithmetically
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(shorts, shorts), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(shorts, shorts), 16);
+		_mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(lo), maxShort));
+		_mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(hi), maxShort));
+	}
+	Short2FloatScalar(in + i, out + i, len - i);
+}
+
+SIMD_TARGET("sse2") static void DeinterleaveShort2FloatSSE2(const short* in, int channels, float* const* out, size_t frames){
+	// Vectorized for stereo and 4 channels, 4 frames per step
+	if(channels != 2 && channels != 4){
+		DeinterleaveShort2FloatScalar(in, channels, out, frames);
+		return;
+	}
+	const __m128 maxShort = _mm_set1_ps(32767.0f);
+	size_t i = 0;
+	for(; i + 4 <= frames; i += 4){
+		// Frames in order, each 4 floats hold 4 / channels frames
+		__m128 v[4];
+		for(int k = 0; k < channels / 2; k++){
+			__m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * channels + 8 * k));
+			v[2 * k] = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(shorts, shorts), 16)), maxShort);
+			v[2 * k + 1] = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(shorts, shorts), 16)), maxShort);
+		}
+		if(channels == 2){
+			v[2] = _mm_shuffle_ps(v[0], v[1], _MM_SHUFFLE(2, 0, 2, 0));
+			v[3] = _mm_shuffle_ps(v[0], v[1], _MM_SHUFFLE(3, 1, 3, 1));
+			v[0] = v[2];
+			v[1] = v[3];
+		}else
+			_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+		for(int c = 0; c < channels; c++){
+			if(out[c])
+				_mm_storeu_ps(out[c] + i, v[c]);
+		}
+	}
+	float* rest[4];
+	for(int c = 0; c < channels; c++)
+		rest[c] = out[c] ? out[c] + i : NULL;
+	DeinterleaveShort2FloatScalar(in + i * channels, channels, rest, frames - i);
+}
+
+SIMD_TARGET("sse2") static double Interpolate4SSE2(const float* in, const float* table, int phases, double pos, double step, float* out, int count){
+	for(int i = 0; i < count; i++){
+		int k = static_cast<int>(pos);
+		double phase = (pos - k) * phases;
+		int r = static_cast<int>(phase);
+		__m128 c0 = _mm_loadu_ps(table + 4 * r);
+		__m128 c = _mm_add_ps(c0, _mm_mul_ps(_mm_set1_ps(static_cast<float>(phase - r)), _mm_sub_ps(_mm_loadu_ps(table + 4 * r + 4), c0)));
+		out[i] = HorizontalSum(_mm_mul_ps(_mm_loadu_ps(in + k), c));
+		pos += step;
+	}
+	return pos;
+}
+
+SIMD_TARGET("sse2") static void MixMonoToStereoSSE2(const float* in, float* out, size_t count, float gainLeft, float gainRight){
+	const __m128 gains = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4){
+		__m128 mono = _mm_loadu_ps(in + i);
+		_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(_mm_unpacklo_ps(mono, mono), gains)));
+		_mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out + 2 * i + 4), _mm_mul_ps(_mm_unpackhi_ps(mono, mono), gains)));
+	}
+	MixMonoToStereoScalar(in + i, out + 2 * i, count - i, gainLeft, gainRight);
+}
+
+SIMD_TARGET("sse2") static float SumMinMaxSSE2(const float* in, size_t count, float* minValue, float* maxValue){
+	__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+	__m128 minV = _mm_set1_ps(*minValue), maxV = _mm_set1_ps(*maxValue);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m128 x0 = _mm_loadu_ps(in + i), x1 = _mm_loadu_ps(in + i + 4);
+		sum0 = _mm_add_ps(sum0, x0);
+		sum1 = _mm_add_ps(sum1, x1);
+		minV = _mm_min_ps(minV, _mm_min_ps(x0, x1));
+		maxV = _mm_max_ps(maxV, _mm_max_ps(x0, x1));
+	}
+	float mins[4], maxs[4];
+	_mm_storeu_ps(mins, minV);
+	_mm_storeu_ps(maxs, maxV);
+	*minValue = std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3]));
+	*maxValue = std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3]));
+	return HorizontalSum(_mm_add_ps(sum0, sum1)) + SumMinMaxScalar(in + i, count - i, minValue, maxValue);
+}
+
+SIMD_TARGET("sse2") static void HalveSSE2(const float* in, float* out, size_t count){
+	const __m128 half = _mm_set1_ps(0.5f);
+	size_t i = 0;
+	// Loads of a block are ahead of its stores, so this also works in place
+	for(; i + 4 <= count; i += 4){
+		__m128 a = _mm_loadu_ps(in + 2 * i), b = _mm_loadu_ps(in + 2 * i + 4);
+		__m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(even, odd), half));
+	}
+	HalveScalar(in + 2 * i, out + i, count - i);
+}
+
+SIMD_TARGET("sse2") static inline __m128 Select(__m128 mask, __m128 a, __m128 b){
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+SIMD_TARGET("sse2") static inline __m128 FastAtan2SSE2(__m128 y, __m128 x){
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 ax = _mm_and_ps(x, absMask), ay = _mm_and_ps(y, absMask);
+	__m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(FLT_MIN)));
+	__m128 s = _mm_mul_ps(a, a);
+	__m128 r = _mm_add_ps(_mm_set1_ps(AtanC4), _mm_mul_ps(s, _mm_set1_ps(AtanC5)));
+	r = _mm_add_ps(_mm_set1_ps(AtanC3), _mm_mul_ps(s, r));
+	r = _mm_add_ps(_mm_set1_ps(AtanC2), _mm_mul_ps(s, r));
+	r = _mm_add_ps(_mm_set1_ps(AtanC1), _mm_mul_ps(s, r));
+	r = _mm_add_ps(_mm_set1_ps(AtanC0), _mm_mul_ps(s, r));
+	r = _mm_mul_ps(a, r);
+	r = Select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(SpecHalfPi), r), r);
+	r = Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(SpecPi), r), r);
+	return _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(y, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+}
+
+SIMD_TARGET("sse2") static inline __m128 FastLnSSE2(__m128 x){
+	__m128i bits = _mm_castps_si128(x);
+	__m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x807FFFFF)), _mm_set1_epi32(0x3F000000)));
+	__m128 small = _mm_cmplt_ps(m, _mm_set1_ps(LnSqrtHalf));
+	e = _mm_add_epi32(e, _mm_castps_si128(small)); // -1 where small
+	m = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(small, m)), _mm_set1_ps(1.0f));
+	__m128 fe = _mm_cvtepi32_ps(e);
+	__m128 z = _mm_mul_ps(m, m);
+	__m128 y = _mm_set1_ps(LnP0);
+	for(float c : {LnP1, LnP2, LnP3, LnP4, LnP5, LnP6, LnP7, LnP8})
+		y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(c));
+	y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+	y = _mm_add_ps(y, _mm_mul_ps(fe, _mm_set1_ps(LnQ1)));
+	y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+	return _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(fe, _mm_set1_ps(LnQ2)));
+}
+
+SIMD_TARGET("sse2") static void SpectrumSSE2(const float* spectrum, float* phase, const float* expectedPhase, int firstBin, int count, float phaseStep, float freqPerBin, float minPower, float dbOffset, float* freq, float* db){
+	const __m128 invPhaseStep = _mm_set1_ps(1.0f / phaseStep), binWidth = _mm_set1_ps(freqPerBin), minPow = _mm_set1_ps(minPower), offset = _mm_set1_ps(dbOffset);
+	const __m128 minusInf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+	__m128 bin = _mm_add_ps(_mm_set1_ps(static_cast<float>(firstBin)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	int i = 0;
+	for(; i + 4 <= count; i += 4){
+		__m128 v0 = _mm_loadu_ps(spectrum + 2 * i), v1 = _mm_loadu_ps(spectrum + 2 * i + 4);
+		__m128 re = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 p = FastAtan2SSE2(im, re);
+		__m128 delta = _mm_sub_ps(_mm_sub_ps(p, _mm_loadu_ps(phase + i)), _mm_loadu_ps(expectedPhase + i));
+		_mm_storeu_ps(phase + i, p);
+		delta = _mm_sub_ps(delta, _mm_mul_ps(_mm_set1_ps(SpecPi), _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(delta, _mm_set1_ps(SpecInvPi))))));
+		__m128 f = _mm_mul_ps(_mm_add_ps(bin, _mm_mul_ps(delta, invPhaseStep)), binWidth);
+		__m128 power = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(f, _mm_set1_ps(1.0f)), _mm_cmpgt_ps(power, minPow));
+		__m128 level = _mm_add_ps(_mm_mul_ps(FastLnSSE2(power), _mm_set1_ps(SpecDbPerNeper)), offset);
+		_mm_storeu_ps(freq + i, _mm_and_ps(valid, f));
+		_mm_storeu_ps(db + i, Select(valid, level, minusInf));
+		bin = _mm_add_ps(bin, _mm_set1_ps(4.0f));
+	}
+	SpectrumScalar(spectrum + 2 * i, phase + i, expectedPhase + i, firstBin + i, count - i, phaseStep, freqPerBin, minPower, dbOffset, freq + i, db + i);
+}
+
+// AVX2
+
+SIMD_TARGET("avx2") static inline float HorizontalSum(__m256 v){
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	__m128 shuf = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(sum, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+SIMD_TARGET("avx2") static float AbsDiffInterpAVX2(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m256 low = _mm256_set1_ps(fLow), high = _mm256_set1_ps(fHigh);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= count; i += 16){
+		__m256 t0 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b + i), low), _mm256_mul_ps(_mm256_loadu_ps(b + i + 1), high));
+		__m256 t1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b + i + 8), low), _mm256_mul_ps(_mm256_loadu_ps(b + i + 9), high));
+		acc0 = _mm256_add_ps(acc0, _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i), t0), absMask));
+		acc1 = _mm256_add_ps(acc1, _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i + 8), t1), absMask));
+	}
+	return HorizontalSum(_mm256_add_ps(acc0, acc1)) + AbsDiffInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("avx2") static float DotInterpAVX2(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m256 low = _mm256_set1_ps(fLow), high = _mm256_set1_ps(fHigh);
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= count; i += 16){
+		__m256 t0 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b + i), low), _mm256_mul_ps(_mm256_loadu_ps(b + i + 1), high));
+		__m256 t1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b + i + 8), low), _mm256_mul_ps(_mm256_loadu_ps(b + i + 9), high));
+		acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), t0));
+		acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), t1));
+	}
+	return HorizontalSum(_mm256_add_ps(acc0, acc1)) + DotInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("avx2") static float DotAVX2(const float* a, const float* b, int count){
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= count; i += 16){
+		acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	return HorizontalSum(_mm256_add_ps(acc0, acc1)) + DotScalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("avx2") static void Dot5AVX2(const float* a, size_t aStride, const float* b, int count, float sums[5]){
+	__m256 acc[5];
+	for(int k = 0; k < 5; k++)
+		acc[k] = _mm256_setzero_ps();
+	int i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m256 xb = _mm256_loadu_ps(b + i);
+		for(int k = 0; k < 5; k++)
+			acc[k] = _mm256_add_ps(acc[k], _mm256_mul_ps(_mm256_loadu_ps(a + k * aStride + i), xb));
+	}
+	for(int k = 0; k < 5; k++)
+		sums[k] = HorizontalSum(acc[k]) + DotScalar(a + k * aStride + i, b + i, count - i);
+}
+
+SIMD_TARGET("avx2") static void Short2FloatAVX2(const short* in, float* out, size_t len){
+	const __m256 maxShort = _mm256_set1_ps(32767.0f);
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8){
+		__m256i ints = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+		_mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_cvtepi32_ps(ints), maxShort));
+	}
+	Short2FloatScalar(in + i, out + i, len - i);
+}
+
+SIMD_TARGET("avx2") static float SumMinMaxAVX2(const float* in, size_t count, float* minValue, float* maxValue){
+	__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+	__m256 minV = _mm256_set1_ps(*minValue), maxV = _mm256_set1_ps(*maxValue);
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16){
+		__m256 x0 = _mm256_loadu_ps(in + i), x1 = _mm256_loadu_ps(in + i + 8);
+		sum0 = _mm256_add_ps(sum0, x0);
+		sum1 = _mm256_add_ps(sum1, x1);
+		minV = _mm256_min_ps(minV, _mm256_min_ps(x0, x1));
+		maxV = _mm256_max_ps(maxV, _mm256_max_ps(x0, x1));
+	}
+	float mins[8], maxs[8];
+	_mm256_storeu_ps(mins, minV);
+	_mm256_storeu_ps(maxs, maxV);
+	*minValue = *std::min_element(mins, mins + 8);
+	*maxValue = *std::max_element(maxs, maxs + 8);
+	return HorizontalSum(_mm256_add_ps(sum0, sum1)) + SumMinMaxScalar(in + i, count - i, minValue, maxValue);
+}
+
+SIMD_TARGET("avx2") static void HalveAVX2(const float* in, float* out, size_t count){
+	const __m256 half = _mm256_set1_ps(0.5f);
+	size_t i = 0;
+	// Loads of a block are ahead of its stores, so this also works in place
+	for(; i + 8 <= count; i += 8){
+		__m256 a = _mm256_loadu_ps(in + 2 * i), b = _mm256_loadu_ps(in + 2 * i + 8);
+		// Pairs per 128 bit lane: a0 a2 b0 b2 | a4 a6 b4 b6, restore the order of the 64 bit halves afterwards
+		__m256 sum = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		sum = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, half));
+	}
+	HalveScalar(in + 2 * i, out + i, count - i);
+}
+
+SIMD_TARGET("avx2") static inline __m256 FastAtan2AVX2(__m256 y, __m256 x){
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 ax = _mm256_and_ps(x, absMask), ay = _mm256_and_ps(y, absMask);
+	__m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(FLT_MIN)));
+	__m256 s = _mm256_mul_ps(a, a);
+	__m256 r = _mm256_add_ps(_mm256_set1_ps(AtanC4), _mm256_mul_ps(s, _mm256_set1_ps(AtanC5)));
+	r = _mm256_add_ps(_mm256_set1_ps(AtanC3), _mm256_mul_ps(s, r));
+	r = _mm256_add_ps(_mm256_set1_ps(AtanC2), _mm256_mul_ps(s, r));
+	r = _mm256_add_ps(_mm256_set1_ps(AtanC1), _mm256_mul_ps(s, r));
+	r = _mm256_add_ps(_mm256_set1_ps(AtanC0), _mm256_mul_ps(s, r));
+	r = _mm256_mul_ps(a, r);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(SpecHalfPi), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(SpecPi), r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+	return _mm256_xor_ps(r, _mm256_and_ps(_mm256_cmp_ps(y, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(-0.0f)));
+}
+
+SIMD_TARGET("avx2") static inline __m256 FastLnAVX2(__m256 x){
+	__m256i bits = _mm256_castps_si256(x);
+	__m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126));
+	__m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x807FFFFF)), _mm256_set1_epi32(0x3F000000)));
+	__m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(LnSqrtHalf), _CMP_LT_OQ);
+	e = _mm256_add_epi32(e, _mm256_castps_si256(small)); // -1 where small
+	m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), _mm256_set1_ps(1.0f));
+	__m256 fe = _mm256_cvtepi32_ps(e);
+	__m256 z = _mm256_mul_ps(m, m);
+	__m256 y = _mm256_set1_ps(LnP0);
+	for(float c : {LnP1, LnP2, LnP3, LnP4, LnP5, LnP6, LnP7, LnP8})
+		y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(c));
+	y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+	y = _mm256_add_ps(y, _mm256_mul_ps(fe, _mm256_set1_ps(LnQ1)));
+	y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+	return _mm256_add_ps(_mm256_add_ps(m, y), _mm256_mul_ps(fe, _mm256_set1_ps(LnQ2)));
+}
+
+SIMD_TARGET("avx2") static void SpectrumAVX2(const float* spectrum, float* phase, const float* expectedPhase, int firstBin, int count, float phaseStep, float freqPerBin, float minPower, float dbOffset, float* freq, float* db){
+	const __m256 invPhaseStep = _mm256_set1_ps(1.0f / phaseStep), binWidth = _mm256_set1_ps(freqPerBin), minPow = _mm256_set1_ps(minPower), offset = _mm256_set1_ps(dbOffset);
+	const __m256 minusInf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+	__m256 bin = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(firstBin)), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	int i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m256 v0 = _mm256_loadu_ps(spectrum + 2 * i), v1 = _mm256_loadu_ps(spectrum + 2 * i + 8);
+		// The shuffles work within the 128 bit lanes, so the 64 bit blocks have to be put in order afterwards
+		__m256 re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		__m256 im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+		__m256 p = FastAtan2AVX2(im, re);
+		__m256 delta = _mm256_sub_ps(_mm256_sub_ps(p, _mm256_loadu_ps(phase + i)), _mm256_loadu_ps(expectedPhase + i));
+		_mm256_storeu_ps(phase + i, p);
+		delta = _mm256_sub_ps(delta, _mm256_mul_ps(_mm256_set1_ps(SpecPi), _mm256_cvtepi32_ps(_mm256_cvtps_epi32(_mm256_mul_ps(delta, _mm256_set1_ps(SpecInvPi))))));
+		__m256 f = _mm256_mul_ps(_mm256_add_ps(bin, _mm256_mul_ps(delta, invPhaseStep)), binWidth);
+		__m256 power = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+		__m256 valid = _mm256_and_ps(_mm256_cmp_ps(f, _mm256_set1_ps(1.0f), _CMP_GT_OQ), _mm256_cmp_ps(power, minPow, _CMP_GT_OQ));
+		__m256 level = _mm256_add_ps(_mm256_mul_ps(FastLnAVX2(power), _mm256_set1_ps(SpecDbPerNeper)), offset);
+		_mm256_storeu_ps(freq + i, _mm256_and_ps(valid, f));
+		_mm256_storeu_ps(db + i, _mm256_blendv_ps(minusInf, level, valid));
+		bin = _mm256_add_ps(bin, _mm256_set1_ps(8.0f));
+	}
+	SpectrumScalar(spectrum + 2 * i, phase + i, expectedPhase + i, firstBin + i, count - i, phaseStep, freqPerBin, minPower, dbOffset, freq + i, db + i);
+}
+
+// AVX-512
+
+#ifdef SIMD_HAVE_AVX512
+SIMD_TARGET("avx512f") static float AbsDiffInterpAVX512(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m512 low = _mm512_set1_ps(fLow), high = _mm512_set1_ps(fHigh);
+	__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= count; i += 32){
+		__m512 t0 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(b + i), low), _mm512_mul_ps(_mm512_loadu_ps(b + i + 1), high));
+		__m512 t1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(b + i + 16), low), _mm512_mul_ps(_mm512_loadu_ps(b + i + 17), high));
+		acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i), t0)));
+		acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i + 16), t1)));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) + AbsDiffInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("avx512f") static float DotInterpAVX512(const float* a, const float* b, int count, float fLow, float fHigh){
+	const __m512 low = _mm512_set1_ps(fLow), high = _mm512_set1_ps(fHigh);
+	__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= count; i += 32){
+		__m512 t0 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(b + i), low), _mm512_mul_ps(_mm512_loadu_ps(b + i + 1), high));
+		__m512 t1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(b + i + 16), low), _mm512_mul_ps(_mm512_loadu_ps(b + i + 17), high));
+		acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_loadu_ps(a + i), t0));
+		acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(_mm512_loadu_ps(a + i + 16), t1));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) + DotInterpScalar(a + i, b + i, count - i, fLow, fHigh);
+}
+
+SIMD_TARGET("avx512f") static float DotAVX512(const float* a, const float* b, int count){
+	__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 32 <= count; i += 32){
+		acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+		acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16)));
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) + DotScalar(a + i, b + i, count - i);
+}
+
+SIMD_TARGET("avx512f") static void Dot5AVX512(const float* a, size_t aStride, const float* b, int count, float sums[5]){
+	__m512 acc[5];
+	for(int k = 0; k < 5; k++)
+		acc[k] = _mm512_setzero_ps();
+	int i = 0;
+	for(; i + 16 <= count; i += 16){
+		__m512 xb = _mm512_loadu_ps(b + i);
+		for(int k = 0; k < 5; k++)
+			acc[k] = _mm512_add_ps(acc[k], _mm512_mul_ps(_mm512_loadu_ps(a + k * aStride + i), xb));
+	}
+	for(int k = 0; k < 5; k++)
+		sums[k] = _mm512_reduce_add_ps(acc[k]) + DotScalar(a + k * aStride + i, b + i, count - i);
+}
+#endif
+
+// CPU detection
+
+static void CpuId(int leaf, int subLeaf, unsigned regs[4]){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, leaf, subLeaf);
+	for(int i = 0; i < 4; i++)
+		regs[i] = static_cast<unsigned>(info[i]);
+#else
+	if(!__get_cpuid_count(leaf, subLeaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+static unsigned long long GetXCR0(){
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+static ESimdLevel DetectSimdLevel(){
+	unsigned regs[4];
+	CpuId(0, 0, regs);
+	unsigned maxLeaf = regs[0];
+	CpuId(1, 0, regs);
+	if(!(regs[3] & (1u << 26))) // SSE2
+		return SIMD_NONE;
+	bool osSavesAVX = false, osSavesAVX512 = false;
+	if(regs[2] & (1u << 27)){ // OSXSAVE
+		unsigned long long xcr0 = GetXCR0();
+		osSavesAVX = (xcr0 & 0x6) == 0x6; // XMM and YMM
+		osSavesAVX512 = (xcr0 & 0xE6) == 0xE6; // additionally opmask and ZMM
+	}
+	if(!osSavesAVX || maxLeaf < 7 || !(regs[2] & (1u << 28))) // AVX
+		return SIMD_SSE2;
+	CpuId(7, 0, regs);
+	if(!(regs[1] & (1u << 5))) // AVX2
+		return SIMD_SSE2;
+#ifdef SIMD_HAVE_AVX512
+	if(osSavesAVX512 && (regs[1] & (1u << 16))) // AVX-512F
+		return SIMD_AVX512;
+#endif
+	return SIMD_AVX2;
+}
+
+#else
+
+static ESimdLevel DetectSimdLevel(){
+	return SIMD_NONE;
+}
+
+#endif // SIMD_X86
+
+// Dispatch
+
+namespace{
+	struct SKernels{
+		ESimdLevel level;
+		float (*dot)(const float*, const float*, int);
+		void (*dot5)(const float*, size_t, const float*, int, float*);
+		float (*absDiffInterp)(const float*, const float*, int, float, float);
+		float (*dotInterp)(const float*, const float*, int, float, float);
+		void (*short2Float)(const short*, float*, size_t);
+		void (*spectrum)(const float*, float*, const float*, int, int, float, float, float, float, float*, float*);
+		double (*interpolate4)(const float*, const float*, int, double, double, float*, int);
+		void (*mixMonoToStereo)(const float*, float*, size_t, float, float);
+		float (*sumMinMax)(const float*, size_t, float*, float*);
+		void (*halve)(const float*, float*, size_t);
+		void (*deinterleaveShort2Float)(const short*, int, float* const*, size_t);
+
+		SKernels(){
+			level = DetectSimdLevel();
+			dot = DotScalar;
+			dot5 = Dot5Scalar;
+			absDiffInterp = AbsDiffInterpScalar;
+			dotInterp = DotInterpScalar;
+			short2Float = Short2FloatScalar;
+			spectrum = SpectrumScalar;
+			interpolate4 = Interpolate4Scalar;
+			mixMonoToStereo = MixMonoToStereoScalar;
+			sumMinMax = SumMinMaxScalar;
+			halve = HalveScalar;
+			deinterleaveShort2Float = DeinterleaveShort2FloatScalar;
+#ifdef SIMD_X86
+			switch(level){
+#ifdef SIMD_HAVE_AVX512
+				case SIMD_AVX512:
+					dot = DotAVX512;
+					dot5 = Dot5AVX512;
+					absDiffInterp = AbsDiffInterpAVX512;
+					dotInterp = DotInterpAVX512;
+					short2Float = Short2FloatAVX2;
+					spectrum = SpectrumAVX2;
+					interpolate4 = Interpolate4SSE2; // Only 4 taps
+					mixMonoToStereo = MixMonoToStereoSSE2; // Limited by memory bandwidth
+					sumMinMax = SumMinMaxAVX2; // Only a few KB per call
+					halve = HalveAVX2;
+					deinterleaveShort2Float = DeinterleaveShort2FloatSSE2; // Shuffling dominates, wider vectors do not help
+					break;
+#endif
+				case SIMD_AVX2:
+					dot = DotAVX2;
+					dot5 = Dot5AVX2;
+					absDiffInterp = AbsDiffInterpAVX2;
+					dotInterp = DotInterpAVX2;
+					short2Float = Short2FloatAVX2;
+					spectrum = SpectrumAVX2;
+					interpolate4 = Interpolate4SSE2; // Only 4 taps
+					mixMonoToStereo = MixMonoToStereoSSE2; // Limited by memory bandwidth
+					sumMinMax = SumMinMaxAVX2;
+					halve = HalveAVX2;
+					deinterleaveShort2Float = DeinterleaveShort2FloatSSE2;
+					break;
+				case SIMD_SSE2:
+					dot = DotSSE2;
+					dot5 = Dot5SSE2;
+					absDiffInterp = AbsDiffInterpSSE2;
+					dotInterp = DotInterpSSE2;
+					short2Float = Short2FloatSSE2;
+					spectrum = SpectrumSSE2;
+					interpolate4 = Interpolate4SSE2;
+					mixMonoToStereo = MixMonoToStereoSSE2;
+					sumMinMax = SumMinMaxSSE2;
+					halve = HalveSSE2;
+					deinterleaveShort2Float = DeinterleaveShort2FloatSSE2;
+					break;
+				default:
+					break;
+			}
+#endif
+		}
+	};
+
+	const SKernels& Kernels(){
+		static const SKernels kernels;
+		return kernels;
+	}
+
+	// Select the kernels when the library is loaded instead of on the first call
+	const SKernels& kernelsInit = Kernels();
+}
+
+ESimdLevel GetSimdLevel(){
+	return Kernels().level;
+}
+
+float SimdDot(const float* a, const float* b, int count){
+	return Kernels().dot(a, b, count);
+}
+
+void SimdDot5(const float* a, size_t aStride, const float* b, int count, float sums[5]){
+	Kernels().dot5(a, aStride, b, count, sums);
+}
+
+float SimdAbsDiffInterp(const float* a, const float* b, int count, float fLow, float fHigh){
+	return Kernels().absDiffInterp(a, b, count, fLow, fHigh);
+}
+
+float SimdDotInterp(const float* a, const float* b, int count, float fLow, float fHigh){
+	return Kernels().dotInterp(a, b, count, fLow, fHigh);
+}
+
+void SimdShort2Float(const short* in, float* out, size_t len){
+	Kernels().short2Float(in, out, len);
+}
+
+void SimdSpectrum(const float* spectrum, float* phase, const float* expectedPhase, int firstBin, int count, float phaseStep, float freqPerBin, float minPower, float dbOffset, float* freq, float* db){
+	Kernels().spectrum(spectrum, phase, expectedPhase, firstBin, count, phaseStep, freqPerBin, minPower, dbOffset, freq, db);
+}
+
+double SimdInterpolate4(const float* in, const float* table, int phases, double pos, double step, float* out, int count){
+	return Kernels().interpolate4(in, table, phases, pos, step, out, count);
+}
+
+void SimdMixMonoToStereo(const float* in, float* out, size_t count, float gainLeft, float gainRight){
+	Kernels().mixMonoToStereo(in, out, count, gainLeft, gainRight);
+}
+
+float SimdSumMinMax(const float* in, size_t count, float* minValue, float* maxValue){
+	return Kernels().sumMinMax(in, count, minValue, maxValue);
+}
+
+void SimdHalve(const float* in, float* out, size_t count){
+	Kernels().halve(in, out, count);
+}
+
+void SimdDeinterleaveShort2Float(const short* in, int channels, float* const* out, size_t frames){
+	Kernels().deinterleaveShort2Float(in, channels, out, frames);
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+
+// Vectorized inner loops of the pitch trackers.
+// The best implementation the CPU supports (SSE2, AVX2, AVX-512) is selected once when the library is loaded.
+
+enum ESimdLevel{
+	SIMD_NONE = 0,
+	SIMD_SSE2 = 1,
+	SIMD_AVX2 = 2,
+	SIMD_AVX512 = 3
+};
+
+/** Instruction set used by the kernels below **/
+ESimdLevel GetSimdLevel();
+
+/** Sum of |a[i] - (b[i] * fLow + b[i+1] * fHigh)| for i in [0, count). Reads b[0..count]. **/
+float SimdAbsDiffInterp(const float* a, const float* b, int count, float fLow, float fHigh);
+/** Sum of a[i] * b[i] for i in [0, count) **/
+float SimdDot(const float* a, const float* b, int count);
+/** sums[k] = Sum of a[k * aStride + i] * b[i] for i in [0, count) and k in [0, 5) (5 dot products with the same b) **/
+void SimdDot5(const float* a, size_t aStride, const float* b, int count, float sums[5]);
+/** Sum of a[i] * (b[i] * fLow + b[i+1] * fHigh) for i in [0, count). Reads b[0..count]. **/
+float SimdDotInterp(const float* a, const float* b, int count, float fLow, float fHigh);
+/** out[i] = in[i] / 32767 for i in [0, len) **/
+void SimdShort2Float(const short* in, float* out, size_t len);
+/** out[c][i] = in[i * channels + c] / 32767 for i in [0, frames) and c in [0, channels) (de-interleave and convert in one pass).
+    Channels with out[c] == NULL are skipped. **/
+void SimdDeinterleaveShort2Float(const short* in, int channels, float* const* out, size_t frames);
+/** Phase vocoder front-end of the performous Analyzer for count FFT bins starting at bin firstBin (spectrum holds interleaved re/im):
+    phase[i] is replaced by the phase of the bin, d = new phase - old phase - expectedPhase[i] mapped into [-pi/2, pi/2] (like remainder(d, pi)),
+    freq[i] = (firstBin + i + d / phaseStep) * freqPerBin and db[i] = 10 * log10(re^2 + im^2) + dbOffset.
+    Bins with freq[i] <= 1 or a power <= minPower get freq[i] = 0 and db[i] = -inf.
+    Uses polynomial approximations: The phase is within 2e-6 rad and the level within 2e-5 dB of the exact values. **/
+void SimdSpectrum(const float* spectrum, float* phase, const float* expectedPhase, int firstBin, int count, float phaseStep, float freqPerBin, float minPower, float dbOffset, float* freq, float* db);
+/** Polyphase FIR interpolation with 4 taps for the positions p = pos + i * step (accumulated) with i in [0, count):
+    out[i] = Sum of in[k + t] * c[t] for t in [0, 4) with k = floor(p). c interpolates linearly between the rows r and r + 1 of table
+    ((phases + 1) rows of 4 coefficients) with r = floor((p - k) * phases). Returns the position after the last output. **/
+double SimdInterpolate4(const float* in, const float* table, int phases, double pos, double step, float* out, int count);
+/** Sum of in[i] for i in [0, count). *minValue and *maxValue are lowered/raised to the smallest/largest in[i].
+    The implementations add in a different order, so the sum can differ in the last bits. **/
+float SimdSumMinMax(const float* in, size_t count, float* minValue, float* maxValue);
+/** out[i] = (in[2 * i] + in[2 * i + 1]) / 2 for i in [0, count) (Haar downsampling). out may be equal to in. **/
+void SimdHalve(const float* in, float* out, size_t count);
+/** out[2 * i] += in[i] * gainLeft and out[2 * i + 1] += in[i] * gainRight for i in [0, count) (mono into interleaved stereo) **/
+void SimdMixMonoToStereo(const float* in, float* out, size_t count, float gainLeft, float gainRight);
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "SlidingAKF.h"
+#include "SimdKernels.h"
+#include "FFT/FFT.h"
+#include <algorithm>
+#include <cmath>
+
+SlidingAKF::SlidingAKF(){
+	_FFTPlan = NULL;
+	_SampleCt = 0;
+	_WindowA = _WindowB = _WindowOmega = 0.;
+	_MaxLag = 0;
+	_MaxHop = 0;
+	_Valid = false;
+	_Position = 0;
+	_Origin = 0;
+	_Start = 0;
+	_HopsSinceSync = 0;
+	_WindowedValid = false;
+}
+
+void SlidingAKF::Init(FFTPlan* plan, int sampleCt, double windowA, double windowB, double windowOmega, const std::vector<int>& lags, const std::vector<float>& periods){
+	_FFTPlan = plan;
+	_SampleCt = sampleCt;
+	_WindowA = windowA;
+	_WindowB = windowB;
+	_WindowOmega = windowOmega;
+	_Valid = false;
+
+	_Lags = lags;
+	std::sort(_Lags.begin(), _Lags.end());
+	_Lags.erase(std::unique(_Lags.begin(), _Lags.end()), _Lags.end());
+	_Periods.clear();
+	for(float samplesPerPeriod : periods){
+		SPeriod period;
+		period.samplesPerPeriod = samplesPerPeriod;
+		period.offset = static_cast<int>(samplesPerPeriod);
+		period.fHigh = samplesPerPeriod - period.offset;
+		period.fLow = 1.0f - period.fHigh;
+		_Periods.push_back(period);
+	}
+	std::sort(_Periods.begin(), _Periods.end(), [](const SPeriod& a, const SPeriod& b){ return a.samplesPerPeriod < b.samplesPerPeriod; });
+
+	// Pairs that enter the window must lie completely within the new part and leaving pairs completely in the old part
+	_MaxLag = _Lags.empty() ? 0 : _Lags.back();
+	int maxLag = _MaxLag;
+	if(!_Periods.empty())
+		maxLag = std::max(maxLag, _Periods.back().offset + 2);
+	_MaxHop = (maxLag < sampleCt) ? sampleCt - maxLag : 0;
+	_Tracked.assign(_MaxLag + 1, 0);
+	for(int lag : _Lags)
+		_Tracked[lag] = 1;
+
+	_Window.resize(sampleCt);
+	for(int i = 0; i < sampleCt; i++)
+		_Window[i] = static_cast<float>(windowA - windowB * cos(windowOmega * i));
+	_LagPhases.resize(2 * _Lags.size());
+	for(size_t l = 0; l < _Lags.size(); l++){
+		_LagPhases[2 * l] = cos(windowOmega * _Lags[l]);
+		_LagPhases[2 * l + 1] = sin(windowOmega * _Lags[l]);
+	}
+	_Weighted.assign(_NumSums * 2 * sampleCt, 0.f);
+	_Sums.assign(_NumSums * _Lags.size(), 0.);
+	_Correlations.assign(_NumSums * (_MaxLag + 1), 0.f);
+	_AMDFSums.assign(_Periods.size(), 0.);
+	_Windowed.resize(sampleCt);
+	_WindowedValid = false;
+}
+
+void SlidingAKF::_StoreSamples(const float* samples, int start, int count, size_t relative){
+	// exp(j * omega * relative), advanced by exp(j * omega) per sample. Doubles keep the error of the rotation negligible over a hop.
+	double cosStep = cos(_WindowOmega), sinStep = sin(_WindowOmega);
+	double cos1 = cos(_WindowOmega * relative), sin1 = sin(_WindowOmega * relative);
+	const size_t ringSize = _SampleCt;
+	float* values[_NumSums];
+	for(int k = 0; k < _NumSums; k++)
+		values[k] = &_Weighted[k * 2 * ringSize];
+	size_t index = start;
+	for(int i = 0; i < count; i++){
+		float sample = samples[i];
+		float weighted[_NumSums] = {sample, static_cast<float>(sample * cos1), static_cast<float>(sample * sin1),
+			static_cast<float>(sample * (cos1 * cos1 - sin1 * sin1)), static_cast<float>(sample * 2. * cos1 * sin1)};
+		for(int k = 0; k < _NumSums; k++){
+			values[k][index] = weighted[k];
+			values[k][index + ringSize] = weighted[k];
+		}
+		if(++index == ringSize)
+			index = 0;
+		double re = cos1 * cosStep - sin1 * sinStep;
+		sin1 = sin1 * cosStep + cos1 * sinStep;
+		cos1 = re;
+	}
+}
+
+void SlidingAKF::_AddSums(int sumBegin, int count, int sign){
+	const float* samples = _WeightedSamples(0);
+	float sums[_NumSums];
+	for(size_t l = 0; l < _Lags.size(); l++){
+		int lag = _Lags[l];
+		int begin = (sumBegin < 0) ? _SampleCt + sumBegin - lag : sumBegin; // negative: relative to the end of the sums
+		SimdDot5(samples + begin, 2 * _SampleCt, samples + begin + lag, count, sums);
+		for(int k = 0; k < _NumSums; k++)
+			_Sums[l * _NumSums + k] += sign * static_cast<double>(sums[k]);
+	}
+}
+
+void SlidingAKF::_Recalculate(const float* samples){
+	_Origin = _Position;
+	_Start = static_cast<int>(_Position % _SampleCt);
+	_StoreSamples(samples, _Start, _SampleCt, 0);
+	// Each sum over all lags is the cross correlation of the weighted samples with the samples
+	float* weighted[_NumSums];
+	float* correlations[_NumSums];
+	for(int k = 0; k < _NumSums; k++){
+		weighted[k] = &_Weighted[k * 2 * _SampleCt + _Start];
+		correlations[k] = &_Correlations[k * (_MaxLag + 1)];
+	}
+	_FFTPlan->RealCrossCorrelations(weighted[0], weighted, correlations, _NumSums, _MaxLag);
+	double scale = 1. / _FFTPlan->GetNumSamples();
+	for(size_t l = 0; l < _Lags.size(); l++){
+		for(int k = 0; k < _NumSums; k++)
+			_Sums[l * _NumSums + k] = correlations[k][_Lags[l]] * scale;
+	}
+	for(size_t p = 0; p < _Periods.size(); p++){
+		const SPeriod& period = _Periods[p];
+		_AMDFSums[p] = SimdAbsDiffInterp(samples, samples + period.offset, _SampleCt - 1 - period.offset, period.fLow, period.fHigh);
+	}
+	_HopsSinceSync = 0;
+	_Valid = true;
+}
+
+void SlidingAKF::Update(const float* samples, size_t position){
+	size_t hop = position - _Position;
+	_Position = position;
+	_WindowedValid = false;
+	if(!_Valid || hop == 0 || hop > _MaxHop || _HopsSinceSync >= _ResyncInterval){
+		_Recalculate(samples);
+		return;
+	}
+	int h = static_cast<int>(hop);
+
+	// Remove the pairs starting in the part that left the window (still stored from the last update)
+	const float* oldSamples = _WeightedSamples(0);
+	_AddSums(0, h, -1);
+	for(size_t p = 0; p < _Periods.size(); p++){
+		const SPeriod& period = _Periods[p];
+		_AMDFSums[p] -= SimdAbsDiffInterp(oldSamples, oldSamples + period.offset, h, period.fLow, period.fHigh);
+	}
+
+	// The new samples replace the ones that left the window in the ring buffer
+	_StoreSamples(samples + _SampleCt - h, _Start, h, position + _SampleCt - h - _Origin);
+	_Start = static_cast<int>(position % _SampleCt);
+
+	// Add the pairs ending in the new part
+	_AddSums(-h, h, 1);
+	for(size_t p = 0; p < _Periods.size(); p++){
+		const SPeriod& period = _Periods[p];
+		int start = _SampleCt - 1 - period.offset - h;
+		_AMDFSums[p] += SimdAbsDiffInterp(samples + start, samples + start + period.offset, h, period.fLow, period.fHigh);
+	}
+	_HopsSinceSync++;
+}
+
+void SlidingAKF::GetAKF(float* akf, float scale) const{
+	// Rotate the weighted sums from the origin to the window start: exp(j*k*omega*(i+shift)) -> exp(j*k*omega*i)
+	double shift = _WindowOmega * static_cast<double>(_Position - _Origin);
+	double cos1 = cos(shift), sin1 = sin(shift);
+	double cos2 = cos(2. * shift), sin2 = sin(2. * shift);
+	// w(i)w(i+l) = a^2 - ab (cos(wi) + cos(w(i+l))) + b^2/2 (cos(wl) + cos(w(2i+l)))
+	double a2 = _WindowA * _WindowA;
+	double ab = _WindowA * _WindowB;
+	double b2Half = _WindowB * _WindowB / 2.;
+	for(size_t l = 0; l < _Lags.size(); l++){
+		const double* sums = &_Sums[l * _NumSums];
+		double re1 = sums[1] * cos1 + sums[2] * sin1, im1 = sums[2] * cos1 - sums[1] * sin1;
+		double re2 = sums[3] * cos2 + sums[4] * sin2, im2 = sums[4] * cos2 - sums[3] * sin2;
+		double cosLag = _LagPhases[2 * l], sinLag = _LagPhases[2 * l + 1];
+		double value = a2 * sums[0]
+			- ab * (re1 * (1. + cosLag) - im1 * sinLag)
+			+ b2Half * (cosLag * sums[0] + re2 * cosLag - im2 * sinLag);
+		akf[_Lags[l]] = static_cast<float>(value * scale);
+	}
+}
+
+float SlidingAKF::CalcAKF(int lag, float scale){
+	if(!_WindowedValid){
+		const float* samples = _WeightedSamples(0);
+		for(int i = 0; i < _SampleCt; i++)
+			_Windowed[i] = samples[i] * _Window[i];
+		_WindowedValid = true;
+	}
+	return SimdDot(_Windowed.data(), _Windowed.data() + lag, _SampleCt - lag) * scale;
+}
+
+bool SlidingAKF::GetAMDF(float samplesPerPeriod, float* amdf) const{
+	auto it = std::lower_bound(_Periods.begin(), _Periods.end(), samplesPerPeriod, [](const SPeriod& a, float b){ return a.samplesPerPeriod < b; });
+	if(it == _Periods.end() || it->samplesPerPeriod != samplesPerPeriod)
+		return false;
+	// The sums of absolute values can only get slightly negative by rounding errors
+	*amdf = static_cast<float>(std::max(0., _AMDFSums[it - _Periods.begin()]) / (_SampleCt - 1 - it->offset));
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+class FFTPlan;
+
+// Keeps the autocorrelation of a (Hamming-like) windowed signal and the AMDF of the raw signal up to date for a fixed set of lags
+// while the analysis window slides over the input. Moving the window by a hop only costs O(hop) per lag,
+// the sums are only calculated from scratch (by FFT) for the first window, after large hops and periodically against rounding errors.
+// Other lags are calculated directly from the samples of the window when needed.
+//
+// The window w(i) = a - b * cos(omega * i) moves with the signal, so the products x(i) * x(i+lag) change their weight on every hop.
+// Expanding w(i) * w(i+lag) gives terms in 1, exp(j*omega*i) and exp(2j*omega*i) though, so it suffices to keep the unweighted sum
+// and two complex weighted sums per lag. Their phases count from the window of the last calculation from scratch (the origin),
+// so the weighted samples never change and the sums are only rotated to the current window start when they are read.
+// The samples are kept in a ring buffer that stores each sample twice, so every window is contiguous and a hop only writes its new samples.
+class SlidingAKF{
+public:
+	SlidingAKF();
+
+	/** Set up for windows of sampleCt samples weighted by windowA - windowB * cos(windowOmega * i).
+	    The AKF is tracked for the given (integer) lags, the AMDF for the given (fractional) periods.
+	    plan (for 2 * sampleCt samples) is used to calculate the sums from scratch, it must outlive this instance. **/
+	void Init(FFTPlan* plan, int sampleCt, double windowA, double windowB, double windowOmega, const std::vector<int>& lags, const std::vector<float>& periods);
+	/** Update for the window starting at sample number position (of the input stream). Starts from scratch if that is not close after the last one. **/
+	void Update(const float* samples, size_t position);
+	/** Forget the last window so the next update starts from scratch **/
+	void Reset(){_Valid = false;}
+	/** Write the windowed autocorrelation of each tracked lag multiplied by scale to akf[lag] **/
+	void GetAKF(float* akf, float scale) const;
+	bool IsTracked(int lag) const {return lag >= 0 && lag <= _MaxLag && _Tracked[lag];}
+	/** Windowed autocorrelation of the current window at any lag (< sampleCt) multiplied by scale, calculated in O(sampleCt) **/
+	float CalcAKF(int lag, float scale);
+	/** Get the AMDF for one of the tracked periods. Returns false if the period is not tracked. **/
+	bool GetAMDF(float samplesPerPeriod, float* amdf) const;
+
+private:
+	static constexpr int _NumSums = 5; // sum of the products and real/imaginary part of the sums weighted by exp(j*omega*i) and exp(2j*omega*i)
+	static constexpr int _ResyncInterval = 64; // Recalculate all sums after this many hops to get rid of accumulated rounding errors
+
+	struct SPeriod{
+		float samplesPerPeriod;
+		int offset; // integer part of samplesPerPeriod
+		float fLow, fHigh; // interpolation factors
+	};
+
+	FFTPlan* _FFTPlan;
+	int _SampleCt;
+	double _WindowA, _WindowB, _WindowOmega;
+	int _MaxLag;
+	size_t _MaxHop;
+	bool _Valid;
+	size_t _Position;
+	size_t _Origin; // Position of the window the phases count from
+	int _Start; // Index of the window start in the ring buffer
+	int _HopsSinceSync;
+	std::vector<int> _Lags;
+	std::vector<char> _Tracked; // For each lag up to _MaxLag
+	std::vector<SPeriod> _Periods; // sorted by samplesPerPeriod
+	std::vector<float> _Window; // a - b * cos(omega * i) for CalcAKF
+	std::vector<double> _LagPhases; // cos/sin(omega * lag) for each lag
+	std::vector<float> _Weighted; // Ring buffers (2 * _SampleCt) of the samples and the samples multiplied by each of the phases
+	std::vector<double> _Sums; // _NumSums values per lag
+	std::vector<float> _Correlations; // Buffer for the FFT results of _Recalculate, _NumSums times all lags up to _MaxLag
+	std::vector<double> _AMDFSums;
+	std::vector<float> _Windowed; // Windowed samples for CalcAKF
+	bool _WindowedValid;
+
+	void _Recalculate(const float* samples);
+	// Store count samples at the ring buffer index start (both copies) with their phases, relative is the distance of the first one to the origin
+	void _StoreSamples(const float* samples, int start, int count, size_t relative);
+	// Add (sign = 1) or subtract (sign = -1) the products of count pairs to the sums of each lag, starting at sumBegin (or _SampleCt - lag + sumBegin if negative)
+	void _AddSums(int sumBegin, int count, int sign);
+	// Samples (sumIndex = 0) or weighted samples of the current window
+	const float* _WeightedSamples(int sumIndex) const {return &_Weighted[sumIndex * 2 * _SampleCt + _Start];}
+};
\ No newline at end of file
@@ -25,6 +25,7 @@
 */
 
 #include "dywapitchtrack.h"
+#include "../SimdKernels.h"
 #include <math.h>
 #include <cmath>
 #include <stdlib.h>
@@ -103,22 +104,74 @@ typedef struct _minmax {
 	struct _minmax *next;
 } minmax;
 
-double _dywapitch_computeWaveletPitch(double * samples, int startsample, int samplecount, float* maxVolume, double volThreshold) {
+void _dywapitch_freeworkspace(dywapitchtracker *pitchtracker) {
+	free(pitchtracker->_sam);
+	free(pitchtracker->_samf);
+	free(pitchtracker->_distances);
+	free(pitchtracker->_mins);
+	free(pitchtracker->_maxs);
+	pitchtracker->_sam = NULL;
+	pitchtracker->_samf = NULL;
+	pitchtracker->_distances = NULL;
+	pitchtracker->_mins = NULL;
+	pitchtracker->_maxs = NULL;
+	pitchtracker->_workspaceSize = 0;
+}
+
+// make the workspace large enough for samplecount samples, the sample buffers are allocated on first use by the caller
+void _dywapitch_reserve(dywapitchtracker *pitchtracker, int samplecount) {
+	if (pitchtracker->_workspaceSize >= samplecount) return;
+	_dywapitch_freeworkspace(pitchtracker);
+	pitchtracker->_distances = (int *)calloc(samplecount, sizeof(int));
+	pitchtracker->_mins = (int *)malloc(sizeof(int)*samplecount);
+	pitchtracker->_maxs = (int *)malloc(sizeof(int)*samplecount);
+	pitchtracker->_workspaceSize = samplecount;
+}
+
+// stages working on all samples, the float versions are vectorized
+// (sum of the samples, lowering/raising minValue/maxValue to the smallest/largest sample)
+double _dywapitch_summinmax(const double * sam, int count, double* minValue, double* maxValue) {
+	double sum = 0.0;
+	for (int i = 0; i < count; i++) {
+		double si = sam[i];
+		sum = sum + si;
+		if (si > *maxValue) *maxValue = si;
+		if (si < *minValue) *minValue = si;
+	}
+	return sum;
+}
+
+float _dywapitch_summinmax(const float * sam, int count, float* minValue, float* maxValue) {
+	return SimdSumMinMax(sam, count, minValue, maxValue);
+}
+
+// halve the sample rate (count output samples), out may be in
+void _dywapitch_downsample(const double * in, double * out, int count) {
+	for (int i = 0; i < count; i++) {
+		out[i] = (in[2*i] + in[2*i + 1])/2.;
+	}
+}
+
+void _dywapitch_downsample(const float * in, float * out, int count) {
+	SimdHalve(in, out, count);
+}
+
+// samples : samplecount (power of 2) input samples, only read
+// sam : workspace for samplecount/2 samples of the same type
+template <typename T>
+double _dywapitch_computeWaveletPitch(dywapitchtracker *pitchtracker, const T * samples, T * sam, int samplecount, float* maxVolume, double volThreshold) {
 	double pitchF = 0.0;
 	
 	int i, j;
-	double si, si1;
-	
-	// must be a power of 2
-	samplecount = _floor_power2(samplecount);
+	T si, si1;
 	
-	double *sam = (double *)malloc(sizeof(double)*samplecount);
-	memcpy(sam, samples + startsample, sizeof(double)*samplecount);
+	// the first level works on the input, the downsampled levels in sam
+	const T *cur = samples;
 	int curSamNb = samplecount;
 	
-	int *distances = (int *)malloc(sizeof(int)*samplecount);
-	int *mins = (int *)malloc(sizeof(int)*samplecount);
-	int *maxs = (int *)malloc(sizeof(int)*samplecount);
+	int *distances = pitchtracker->_distances;
+	int *mins = pitchtracker->_mins;
+	int *maxs = pitchtracker->_maxs;
 	int nbMins, nbMaxs;
 	
 	// algorithm parameters
@@ -127,23 +180,18 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 	int differenceLevelsN = 3;
 	double maximaThresholdRatio = 0.75;
 	
-	double ampltitudeThreshold;  
-	double theDC = 0.0;
+	T ampltitudeThreshold;  
+	T theDC = 0.0;
 	
 	{ // compute ampltitudeThreshold and theDC
 		//first compute the DC and maxAMplitude
-		double maxValue = 0.0;
-		double minValue = 0.0;
-		for (i = 0; i < samplecount;i++) {
-			si = sam[i];
-			theDC = theDC + si;
-			if (si > maxValue) maxValue = si;
-			if (si < minValue) minValue = si;
-		}
+		T maxValue = 0.0;
+		T minValue = 0.0;
+		theDC = _dywapitch_summinmax(cur, samplecount, &minValue, &maxValue);
 		theDC = theDC/samplecount;
 		maxValue = maxValue - theDC;
 		minValue = minValue - theDC;
-		double amplitudeMax = (maxValue > -minValue ? maxValue : -minValue);
+		T amplitudeMax = (maxValue > -minValue ? maxValue : -minValue);
 		*maxVolume = static_cast<float>(amplitudeMax + theDC);
 		if(*maxVolume < volThreshold)
 			return 0.0;
@@ -169,15 +217,15 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 		// compute the first maximums and minumums after zero-crossing
 		// store if greater than the min threshold
 		// and if at a greater distance than delta
-		double dv, previousDV = -1000;
+		T dv, previousDV = -1000;
 		nbMins = nbMaxs = 0;   
 		int lastMinIndex = -1000000;
 		int lastmaxIndex = -1000000;
 		int findMax = 0;
 		int findMin = 0;
 		for (i = 2; i < curSamNb; i++) {
-			si = sam[i] - theDC;
-			si1 = sam[i-1] - theDC;
+			si = cur[i] - theDC;
+			si1 = cur[i-1] - theDC;
 			
 			if (si1 <= 0 && si > 0) findMax = 1;
 			if (si1 >= 0 && si < 0) findMin = 1;
@@ -189,7 +237,7 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 				
 				if (findMin && previousDV < 0 && dv >= 0) { 
 					// minimum
-					if (fabs(si) >= ampltitudeThreshold) {
+					if (std::fabs(si) >= ampltitudeThreshold) {
 						if (i > lastMinIndex + delta) {
 							mins[nbMins++] = i;
 							lastMinIndex = i;
@@ -208,7 +256,7 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 				
 				if (findMax && previousDV > 0 && dv <= 0) {
 					// maximum
-					if (fabs(si) >= ampltitudeThreshold) {
+					if (std::fabs(si) >= ampltitudeThreshold) {
 						if (i > lastmaxIndex + delta) {
 							maxs[nbMaxs++] = i;
 							lastmaxIndex = i;
@@ -237,15 +285,17 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 		//if DEBUGG then put count(maxs)&&"maxs &"&&count(mins)&&"mins"
 		
 		// maxs = [5, 20, 100,...]
-		// compute distances
+		// compute distances (the histogram is all zero, remember the range we touch)
 		int d;
-		memset(distances, 0, samplecount*sizeof(int));
+		int minDist = curSamNb, maxDist = -1;
 		for (i = 0 ; i < nbMins ; i++) {
 			for (j = 1; j < differenceLevelsN; j++) {
 				if (i+j < nbMins) {
 					d = _iabs(mins[i] - mins[i+j]);
 					//asLog("dywapitch i=%ld j=%ld d=%ld\n", i, j, d);
 					distances[d] = distances[d] + 1;
+					if (d < minDist) minDist = d;
+					if (d > maxDist) maxDist = d;
 				}
 			}
 		}
@@ -255,27 +305,39 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 					d = _iabs(maxs[i] - maxs[i+j]);
 					//asLog("dywapitch i=%ld j=%ld d=%ld\n", i, j, d);
 					distances[d] = distances[d] + 1;
+					if (d < minDist) minDist = d;
+					if (d > maxDist) maxDist = d;
 				}
 			}
 		}
 		
-		// find best summed distance
-		int bestDistance = -1;
-		int bestValue = -1;
-		for (i = 0; i< curSamNb; i++) {
+		// find best summed distance: sum over [i-delta, i+delta] for all i, the first maximum wins
+		// (or its double). Outside of [minDist-delta, maxDist+delta] the sums are 0, which only matters for i = 0.
+		int bestDistance = 0;
+		int bestValue = 0;
+		if (maxDist >= 0) {
+			int first = (max(0, minDist - delta));
+			int last = (min(curSamNb - 1, maxDist + delta));
 			int summed = 0;
-			for (j = -delta ; j <= delta ; j++) {
-				if (i+j >=0 && i+j < curSamNb)
-					summed += distances[i+j];
-			}
-			//asLog("dywapitch i=%ld summed=%ld bestDistance=%ld\n", i, summed, bestDistance);
-			if (summed == bestValue) {
-				if (i == 2*bestDistance)
+			int windowEnd = (min(curSamNb - 1, first + delta));
+			for (j = (max(0, first - delta)); j <= windowEnd; j++)
+				summed += distances[j];
+			if (first == 0) bestValue = -1;
+			for (i = first; i <= last; i++) {
+				if (i > first) {
+					// slide the window
+					if (i + delta < curSamNb) summed += distances[i + delta];
+					if (i - delta - 1 >= 0) summed -= distances[i - delta - 1];
+				}
+				//asLog("dywapitch i=%ld summed=%ld bestDistance=%ld\n", i, summed, bestDistance);
+				if (summed == bestValue) {
+					if (i == 2*bestDistance)
+						bestDistance = i;
+					
+				} else if (summed > bestValue) {
+					bestValue = summed;
 					bestDistance = i;
-				
-			} else if (summed > bestValue) {
-				bestValue = summed;
-				bestDistance = i;
+				}
 			}
 		}
 		//asLog("dywapitch bestDistance=%ld\n", bestDistance);
@@ -294,6 +356,9 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 		}
 		// this is our mode distance !
 		distAvg /= nbDists;
+		// leave the histogram cleared for the next level/call
+		if (maxDist >= 0)
+			memset(distances + minDist, 0, (maxDist - minDist + 1)*sizeof(int));
 		//asLog("dywapitch distAvg=%f\n", distAvg);
 		
 		// continue the levels ?
@@ -324,19 +389,13 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
  			//asLog("dywapitch not enough samples, exiting\n");
 			goto cleanup;
 		}
-		for (i = 0; i < curSamNb/2; i++) {
-			sam[i] = (sam[2*i] + sam[2*i + 1])/2.;
-		}
+		_dywapitch_downsample(cur, sam, curSamNb/2);
+		cur = sam;
 		curSamNb /= 2;
 	}
 	
 	///
 cleanup:
-	free(distances);
-	free(mins);
-	free(maxs);
-	free(sam);
-	
 	return pitchF;
 }
 
@@ -441,10 +500,34 @@ double _dywapitch_dynamicprocess(dywapitchtracker *pitchtracker, double pitch) {
 void dywapitch_inittracking(dywapitchtracker *pitchtracker) {
 	pitchtracker->_prevPitch = -1.;
 	pitchtracker->_pitchConfidence = -1;
+	pitchtracker->_workspaceSize = 0;
+	pitchtracker->_sam = NULL;
+	pitchtracker->_samf = NULL;
+	pitchtracker->_distances = NULL;
+	pitchtracker->_mins = NULL;
+	pitchtracker->_maxs = NULL;
+}
+
+void dywapitch_freetracking(dywapitchtracker *pitchtracker) {
+	_dywapitch_freeworkspace(pitchtracker);
 }
 
 double dywapitch_computepitch(dywapitchtracker *pitchtracker, double * samples, int startsample, int samplecount, float* maxVolume, double volThreshold) {
-	double raw_pitch = _dywapitch_computeWaveletPitch(samples, startsample, samplecount, maxVolume, volThreshold);
+	// must be a power of 2
+	samplecount = _floor_power2(samplecount);
+	_dywapitch_reserve(pitchtracker, samplecount);
+	if (!pitchtracker->_sam)
+		pitchtracker->_sam = (double *)malloc(sizeof(double)*pitchtracker->_workspaceSize/2);
+	double raw_pitch = _dywapitch_computeWaveletPitch(pitchtracker, samples + startsample, pitchtracker->_sam, samplecount, maxVolume, volThreshold);
+	return _dywapitch_dynamicprocess(pitchtracker, raw_pitch);
+}
+
+double dywapitch_computepitchf(dywapitchtracker *pitchtracker, const float * samples, int startsample, int samplecount, float* maxVolume, double volThreshold) {
+	samplecount = _floor_power2(samplecount);
+	_dywapitch_reserve(pitchtracker, samplecount);
+	if (!pitchtracker->_samf)
+		pitchtracker->_samf = (float *)malloc(sizeof(float)*pitchtracker->_workspaceSize/2);
+	double raw_pitch = _dywapitch_computeWaveletPitch(pitchtracker, samples + startsample, pitchtracker->_samf, samplecount, maxVolume, volThreshold);
 	return _dywapitch_dynamicprocess(pitchtracker, raw_pitch);
 }
 
@@ -85,6 +85,13 @@ extern "C" {
 typedef struct _dywapitchtracker {
 	double	_prevPitch;
 	int		_pitchConfidence;
+	// workspace of the wavelet algorithm, (re)allocated when a call needs more than _workspaceSize samples
+	int		_workspaceSize;
+	double	*_sam; // downsampled levels (double and float version)
+	float	*_samf;
+	int		*_distances; // histogram, all zero between calls
+	int		*_mins;
+	int		*_maxs;
 } dywapitchtracker;
 
 // returns the number of samples needed to compute pitch for fequencies equal and above the given minFreq (in Hz)
@@ -95,6 +102,9 @@ int dywapitch_neededsamplecount(int minFreq);
 // call before computing any pitch, passing an allocated dywapitchtracker structure
 void dywapitch_inittracking(dywapitchtracker *pitchtracker);
 
+// call when done with the tracker to free its workspace (before calling dywapitch_inittracking on it again)
+void dywapitch_freetracking(dywapitchtracker *pitchtracker);
+
 // computes the pitch. Pass the inited dywapitchtracker structure
 // samples : a pointer to the sample buffer
 // startsample : the index of the first sample to use in the sample buffer
@@ -102,6 +112,9 @@ void dywapitch_inittracking(dywapitchtracker *pitchtracker);
 // return 0.0 if no pitch was found (sound too low, noise, etc..)
 double dywapitch_computepitch(dywapitchtracker *pitchtracker, double * samples, int startsample, int samplecount, float* maxVolume, double volThreshold);
 
+// same as dywapitch_computepitch for float samples, computing in float with vectorized DC/min/max and downsampling stages
+double dywapitch_computepitchf(dywapitchtracker *pitchtracker, const float * samples, int startsample, int samplecount, float* maxVolume, double volThreshold);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
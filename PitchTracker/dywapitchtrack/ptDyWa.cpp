@@ -9,12 +9,16 @@ PtDyWa::PtDyWa(unsigned step){
 	_LastMaxVol = 0.f;
 }
 
+PtDyWa::~PtDyWa(){
+	dywapitch_freetracking(&_State);
+}
+
 void PtDyWa::SetVolumeThreshold(float threshold){
 	_VolTreshold = threshold;
 }
 
 double PtDyWa::FindNote(float* maxVolume){
-	double AnaylsisBuf[_SampleCt];
+	float AnaylsisBuf[_SampleCt];
 	size_t size = _AnalysisBuf.size();
 	if(size > _SampleCt)
 		_AnalysisBuf.pop(size - _SampleCt);
@@ -23,7 +27,7 @@ double PtDyWa::FindNote(float* maxVolume){
 		return -1;
 	}
 	_AnalysisBuf.pop(_Step);
-	double pitch = dywapitch_computepitch(&_State, AnaylsisBuf, 0, _SampleCt, maxVolume, _VolTreshold);
+	double pitch = dywapitch_computepitchf(&_State, AnaylsisBuf, 0, _SampleCt, maxVolume, _VolTreshold);
 	if(pitch == 0.0)
 		return -1;
 	else
@@ -5,11 +5,16 @@
 class PtDyWa{
 public:
 	PtDyWa(unsigned step);
+	~PtDyWa();
 
 	/** Add input data to buffer. This is thread-safe (against other functions). **/
 	template <typename InIt> void input(InIt begin, InIt end) {
 		_AnalysisBuf.insert(begin, end);
 	}
+	/** Add signed 16 bit input data to buffer, converting it on the fly. **/
+	void inputShort(short const* begin, short const* end) {
+		_AnalysisBuf.insertShort(begin, end);
+	}
 
 	double FindNote(float* maxVolume);
 	void SetVolumeThreshold(float threshold);
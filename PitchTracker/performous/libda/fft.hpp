@@ -17,8 +17,26 @@
 
 namespace da {
 
-	// With g++ optimization -fcx-limited-range should be used for 5x performance boost.
-	
+	/// Complex multiplication without the NaN/Inf handling of operator* (which usually is a library call)
+	template<typename T> inline std::complex<T> mul(std::complex<T> a, std::complex<T> b) {
+		return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+	/// Twiddle factors exp(-i tau k / 2^P) for k in [0, 2^(P-1)), calculated once per size
+	template<unsigned P, typename T> struct Twiddles {
+		static std::complex<T> const* get() {
+			static const std::vector<std::complex<T> > table = make();
+			return &table[0];
+		}
+	private:
+		static std::vector<std::complex<T> > make() {
+			constexpr std::size_t N = 1 << P;
+			std::vector<std::complex<T> > table(N / 2);
+			for (std::size_t k = 0; k < N / 2; ++k) table[k] = std::complex<T>(std::polar(1.0, -M_TAU * k / N));
+			return table;
+		}
+	};
+
 	// Based on the description of Volodymyr Myrnyy in
 	// http://www.dspdesignline.com/showArticle.jhtml?printableArticle=true&articleId=199903272
 	template<unsigned P, typename T> struct DanielsonLanczos {
@@ -29,12 +47,11 @@ namespace da {
 			DanielsonLanczos<P - 1, T>().apply(data);
 			DanielsonLanczos<P - 1, T>().apply(data + M);
 			// Combine the results
-			std::complex<T> w(1.0);
+			std::complex<T> const* w = Twiddles<P, T>::get();
 			for (std::size_t i = 0; i < M; ++i) {
-				const std::complex<T> temp = data[i + M] * w;
+				const std::complex<T> temp = mul(data[i + M], w[i]);
 				data[M + i] = data[i] - temp;
 				data[i] += temp;
-				w *= std::polar(1.0, -M_TAU / N);
 			}
 		}
 	};
@@ -56,20 +73,44 @@ namespace da {
 		DanielsonLanczos<P, T>::apply(data);
 	}
 
-	/** Perform FFT on data from floating point iterator, windowing the input. **/
-	template<unsigned P, typename InIt, typename Window> std::vector<std::complex<float> > fft(InIt begin, Window window) {
-		std::vector<std::complex<float> > data(1 << P);
-		// Perform bit-reversal sorting of sample data.
+	/** Perform FFT on 2^P real values from floating point iterator, windowing the input, into out (2^P values).
+	    Pairs of values are packed into complex ones for an FFT of half the size. Does not allocate memory. **/
+	template<unsigned P, typename InIt, typename Window> void fft(InIt begin, Window const& window, std::complex<float>* out) {
 		constexpr std::size_t N = 1 << P;
+		constexpr std::size_t M = N / 2;
+		// Perform bit-reversal sorting of sample data, z[n] = x[2n] + i x[2n+1]
 		std::size_t j = 0;
-		for (std::size_t i = 0; i < N; ++i) {
-			data[j] = *begin++ * window[i];
-			std::size_t m = N / 2;
+		for (std::size_t i = 0; i < M; ++i) {
+			float re = *begin++ * window[2 * i];
+			float im = *begin++ * window[2 * i + 1];
+			out[j] = std::complex<float>(re, im);
+			std::size_t m = M / 2;
 			while (m > 1 && m <= j) { j -= m; m >>= 1; }
 			j += m;
 		}
-		// Do the actual calculation
-		DanielsonLanczos<P, float>::apply(&data[0]);
+		DanielsonLanczos<P - 1, float>::apply(out);
+		// Split Z into the transforms of the even (E) and odd (O) values: X[k] = E[k] + w^k O[k] and X[M-k] = conj(E[k] - w^k O[k])
+		// with E[k] = (Z[k] + conj(Z[M-k])) / 2 and O[k] = (Z[k] - conj(Z[M-k])) / 2i
+		std::complex<float> const* w = Twiddles<P, float>::get();
+		const float z0re = out[0].real(), z0im = out[0].imag();
+		out[0] = z0re + z0im;
+		out[M] = z0re - z0im;
+		for (std::size_t k = 1; k <= M / 2; ++k) {
+			const std::complex<float> zk = out[k], zmk = std::conj(out[M - k]);
+			const std::complex<float> e = 0.5f * (zk + zmk);
+			const std::complex<float> d = zk - zmk;
+			const std::complex<float> wo = mul(w[k], std::complex<float>(0.5f * d.imag(), -0.5f * d.real()));
+			out[k] = e + wo;
+			out[M - k] = std::conj(e - wo);
+		}
+		// The spectrum of real values is conjugate symmetric
+		for (std::size_t k = 1; k < M; ++k) out[N - k] = std::conj(out[k]);
+	}
+
+	/** Perform FFT on data from floating point iterator, windowing the input. **/
+	template<unsigned P, typename InIt, typename Window> std::vector<std::complex<float> > fft(InIt begin, Window window) {
+		std::vector<std::complex<float> > data(1 << P);
+		fft<P>(begin, window, &data[0]);
 		return data;
 	}
 
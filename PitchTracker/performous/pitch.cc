@@ -2,13 +2,18 @@
 
 #include "util.hh"
 #include "libda/fft.hpp"
+#include "../SimdKernels.h"
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <chrono>
+#include <stdexcept>
 
 // Limit the range to avoid noise and useless computation
 static const double FFT_MINFREQ = 45.0;
 static const double FFT_MAXFREQ = 5000.0;
+// Initial capacity of the tone lists (they only grow if more tones are found at once)
+static const std::size_t TONES_RESERVE = 64;
 
 Tone::Tone():
   freq(0.0),
@@ -30,25 +35,101 @@ bool Tone::operator==(double f) const {
 	return std::abs(freq / f - 1.0) < 0.05;
 }
 
-Analyzer::Analyzer(double rate, std::string id, unsigned step):
+namespace {
+	/// Polyphase table of the Lanczos kernel (a = 2) used for the pass-through, including its gain of 5
+	/** Row r holds the weights of the samples k + 1 .. k + 4 (the one at k is always 0) for position k + r / PHASES. **/
+	struct LanczosTable {
+		static const int PHASES = 256;
+		std::vector<float> coeffs;
+		LanczosTable(): coeffs((PHASES + 1) * 4) {
+			for (int r = 0; r <= PHASES; ++r) {
+				double x = double(r) / PHASES;
+				for (int t = 0; t < 4; ++t) coeffs[r * 4 + t] = static_cast<float>(5.0 * da::lanc<2>(x + 1.0 - t));
+			}
+		}
+	};
+
+	LanczosTable const& lanczosTable() {
+		static const LanczosTable table;
+		return table;
+	}
+
+	/// The harmonics n < 8 and dividers n < div <= Tone::MAXHARM that findDivider scores, sorted by div / n
+	/** first[q] is the first entry with div / n >= q / STEPS, the last entry is a sentinel. **/
+	struct HarmonicTable {
+		static const int STEPS = 16;
+		struct Entry {
+			double ratio;  ///< div / n
+			unsigned n, div;
+			bool operator<(Entry const& other) const { return ratio < other.ratio; }
+		};
+		std::vector<Entry> entries;
+		std::vector<unsigned> first;
+		HarmonicTable(): first(Tone::MAXHARM * STEPS + 1) {
+			for (unsigned n = 1; n < 8; ++n) {
+				for (unsigned div = n + 1; div <= Tone::MAXHARM; ++div) entries.push_back(Entry{double(div) / n, n, div});
+			}
+			std::sort(entries.begin(), entries.end());
+			entries.push_back(Entry{getInf(), 0, 0});
+			unsigned i = 0;
+			for (std::size_t q = 0; q < first.size(); ++q) {
+				while (entries[i].ratio < double(q) / STEPS) ++i;
+				first[q] = i;
+			}
+		}
+	};
+
+	HarmonicTable const& harmonicTable() {
+		static const HarmonicTable table;
+		return table;
+	}
+}
+
+std::unique_ptr<Analyzer> Analyzer::create(double rate, std::string id, unsigned step, std::size_t fftSize) {
+	switch (fftSize) {
+		case 512: return std::unique_ptr<Analyzer>(new FFTAnalyzer<9>(rate, id, step));
+		case 1024: return std::unique_ptr<Analyzer>(new FFTAnalyzer<10>(rate, id, step));
+		case 2048: return std::unique_ptr<Analyzer>(new FFTAnalyzer<11>(rate, id, step));
+		case 4096: return std::unique_ptr<Analyzer>(new FFTAnalyzer<12>(rate, id, step));
+		default: throw std::invalid_argument("Analyzer: Unsupported FFT size");
+	}
+}
+
+Analyzer::Analyzer(double rate, std::string id, unsigned step, std::size_t fftSize):
   m_step(step),
+  m_fftSize(fftSize),
+  m_window(fftSize),
+  m_fft(fftSize),
+  m_peak(0.0),
   m_resampleFactor(1.0),
   m_resamplePos(),
   m_rate(rate),
   m_id(id),
-  m_window(FFT_N),
-  m_fftLastPhase(FFT_N / 2),
-  m_peak(0.0),
-  m_oldfreq(0.0)
+  m_fftLastPhase(fftSize / 2 + 1),
+  m_expectedPhase(fftSize / 2 + 1),
+  m_peaks(fftSize / 2 + 1),
+  m_binFreq(fftSize / 2 + 1),
+  m_binDb(fftSize / 2 + 1),
+  m_oldfreq(0.0),
+  m_maxWindows(0),
+  m_maxMicros(0)
 {
-	if (m_step > FFT_N) throw std::logic_error("Analyzer step is larger that FFT_N (ideally it should be less than a fourth of FFT_N).");
+	if (m_step > m_fftSize) throw std::logic_error("Analyzer step is larger that the FFT size (ideally it should be less than a fourth of it).");
+	const double phaseStep = 2.0 * M_PI * m_step / m_fftSize;
+	for (size_t k = 0; k <= m_fftSize / 2; ++k) m_expectedPhase[k] = static_cast<float>(remainder(k * phaseStep, M_PI));
+	m_tones.reserve(TONES_RESERVE);
+	m_newTones.reserve(TONES_RESERVE);
+	m_mergedTones.reserve(TONES_RESERVE);
+	m_peakIndex.reserve(m_fftSize / 2 + 1);
+	lanczosTable();  // Calculate it here rather than in output() on the audio thread
+	harmonicTable();  // And this one rather than in process()
 	// Hamming window
-	for (size_t i=0; i < FFT_N; i++) {
-		m_window[i] = static_cast<float>(0.53836 - 0.46164 * std::cos(2.0 * M_PI * i / (FFT_N - 1)));
+	for (size_t i=0; i < m_fftSize; i++) {
+		m_window[i] = static_cast<float>(0.53836 - 0.46164 * std::cos(2.0 * M_PI * i / (m_fftSize - 1)));
 	}
 }
 
-bool Analyzer::output(float* begin, float* end, double rate) {
+bool Analyzer::output(float* begin, float* end, double rate, float gainLeft, float gainRight) {
 	constexpr unsigned a = 2;
 	const size_t size = m_passthrough.size();
 	const unsigned out = static_cast<unsigned>((end - begin) / 2 /* stereo */);
@@ -57,16 +138,13 @@ bool Analyzer::output(float* begin, float* end, double rate) {
 	float pcm[m_passthrough.capacity];
 	if(!m_passthrough.read(pcm, pcm + in + 4))
 		return false;
-	for (unsigned i = 0; i < out; ++i) {
-		double s = 0.0;
-		unsigned k = static_cast<unsigned>(m_resamplePos);
-		double x = m_resamplePos - k;
-		// Lanczos sampling of input at m_resamplePos
-		for (unsigned j = 0; j <= 2 * a; ++j) s += pcm[k + j] * da::lanc<a>(x - j + a);
-		s *= 5.0;
-		begin[i * 2] += (float) s;
-		begin[i * 2 + 1] += (float) s;
-		m_resamplePos += m_resampleFactor;
+	// Lanczos sampling of input at m_resamplePos, in chunks for the mono result
+	LanczosTable const& table = lanczosTable();
+	float mono[256];
+	for (unsigned i = 0; i < out; i += 256) {
+		const unsigned count = std::min(out - i, 256u);
+		m_resamplePos = SimdInterpolate4(pcm + 1, &table.coeffs[0], LanczosTable::PHASES, m_resamplePos, m_resampleFactor, mono, static_cast<int>(count));
+		SimdMixMonoToStereo(mono, begin + i * 2, count, gainLeft, gainRight);
 	}
 	unsigned num = static_cast<unsigned>(m_resamplePos);
 	m_resamplePos -= num;
@@ -82,70 +160,67 @@ bool Analyzer::output(float* begin, float* end, double rate) {
 }
 
 
-namespace {
-	struct Peak {
-		double freq;
-		double db;
-		bool harm[Tone::MAXHARM];
-		Peak(double _freq = 0.0, double _db = -getInf()):
-		  freq(_freq), db(_db)
-		{
-			for (auto& h: harm) h = false;
-		}
-		void clear() {
-			freq = 0.0;
-			db = -getInf();
-		}
-	};
+void Analyzer::Peak::clear() {
+	freq = 0.0;
+	db = -getInf();
+}
 
-	Peak& match(std::vector<Peak>& peaks, std::size_t pos) {
-		std::size_t best = pos;
-		if (peaks[pos - 1].db > peaks[best].db) best = pos - 1;
-		if (peaks[pos + 1].db > peaks[best].db) best = pos + 1;
-		return peaks[best];
-	}
+Analyzer::Peak& Analyzer::match(std::vector<Peak>& peaks, std::size_t pos) {
+	std::size_t best = pos;
+	if (peaks[pos - 1].db > peaks[best].db) best = pos - 1;
+	if (peaks[pos + 1].db > peaks[best].db) best = pos + 1;
+	return peaks[best];
 }
 
-bool Analyzer::calcFFT() {
-	float pcm[FFT_N];
-	// Read FFT_N samples, move forward by m_step samples
-	if (!m_buf.read(pcm, pcm + FFT_N)) return false;
+template <unsigned P> bool FFTAnalyzer<P>::calcFFT() {
+	float pcm[N];
+	// Read N samples, move forward by m_step samples
+	if (!m_buf.read(pcm, pcm + N)) return false;
 	m_buf.pop(m_step);
 	// Peak level calculation of the most recent m_step samples (the rest is overlap)
-	for (float const* ptr = pcm + FFT_N - m_step; ptr != pcm + FFT_N; ++ptr) {
+	for (float const* ptr = pcm + N - m_step; ptr != pcm + N; ++ptr) {
 		float s = *ptr;
 		float p = s * s;
 		if (p > m_peak) m_peak = p; else m_peak *= 0.999;
 	}
 	// Calculate FFT
-	m_fft = da::fft<FFT_P>(pcm, m_window);
+	da::fft<P>(pcm, m_window, &m_fft[0]);
 	return true;
 }
 
-void Analyzer::calcTones() {
+template <unsigned P> size_t FFTAnalyzer<P>::windowsAvailable() const {
+	size_t size = m_buf.size();
+	return size < N ? 0 : (size - N) / m_step + 1;
+}
+
+template class FFTAnalyzer<9>;
+template class FFTAnalyzer<10>;
+template class FFTAnalyzer<11>;
+template class FFTAnalyzer<12>;
+
+void Analyzer::calcSpectrum(size_t kMax) {
 	// Precalculated constants
-	const double freqPerBin = m_rate / FFT_N;
-	const double phaseStep = 2.0 * M_PI * m_step / FFT_N;
-	const double normCoeff = 1.0 / FFT_N;
+	const double freqPerBin = m_rate / m_fftSize;
+	const double phaseStep = 2.0 * M_PI * m_step / m_fftSize;
+	const double normCoeff = 1.0 / m_fftSize;
 	const double minMagnitude = pow(10, -100.0 / 20.0) / normCoeff; // -100 dB
+	// Phase vocoder: The phase difference to the previous window (minus the expected one) gives the true frequency of each bin
+	SimdSpectrum(reinterpret_cast<const float*>(&m_fft[1]), &m_fftLastPhase[1], &m_expectedPhase[1], 1, static_cast<int>(kMax),
+	  static_cast<float>(phaseStep), static_cast<float>(freqPerBin), static_cast<float>(minMagnitude * minMagnitude),
+	  static_cast<float>(20.0 * log10(normCoeff)), &m_binFreq[1], &m_binDb[1]);
+}
+
+void Analyzer::calcTones() {
+	const double freqPerBin = m_rate / m_fftSize;
 	// Limit frequency range of processing
 	const size_t kMin = std::max(size_t(1), size_t(FFT_MINFREQ / freqPerBin));
-	const size_t kMax = std::min(FFT_N / 2, size_t(FFT_MAXFREQ / freqPerBin));
-	std::vector<Peak> peaks(kMax + 1); // One extra to simplify loops
+	const size_t kMax = std::min(m_fftSize / 2, size_t(FFT_MAXFREQ / freqPerBin));
+	calcSpectrum(kMax);
+	std::vector<Peak>& peaks = m_peaks; // One extra to simplify loops
+	peaks[0].clear();
 	for (size_t k = 1; k <= kMax; ++k) {
-		double magnitude = std::abs(m_fft[k]);
-		double phase = std::arg(m_fft[k]);
-		// process phase difference
-		double delta = phase - m_fftLastPhase[k];
-		m_fftLastPhase[k] = static_cast<float>(phase);
-		delta -= k * phaseStep;  // subtract expected phase difference
-		delta = remainder(delta, M_PI);  // map delta phase into +/- M_PI interval
-		delta /= phaseStep;  // calculate diff from bin center frequency
-		double freq = (k + delta) * freqPerBin;  // calculate the true frequency
-		if (freq > 1.0 && magnitude > minMagnitude) {
-			peaks[k].freq = freq;
-			peaks[k].db = 20.0 * log10(normCoeff * magnitude);
-		}
+		peaks[k].freq = m_binFreq[k];
+		peaks[k].db = m_binDb[k];
 	}
 	// Prefilter peaks
 	double prevdb = peaks[0].db;
@@ -155,29 +230,19 @@ void Analyzer::calcTones() {
 		if (db < prevdb) peaks[k].clear();
 		prevdb = db;
 	}
+	// Index of the peaks left (only those with a positive frequency can be harmonics of a positive fundamental)
+	m_peakIndex.clear();
+	for (size_t k = 1; k <= kMax; ++k) {
+		if (peaks[k].db > -getInf() && peaks[k].freq > 0.0) {
+			m_peakIndex.push_back(IndexedPeak{k, 1.0 / (k + 2), k > 1 ? 1.001 / (k - 1) : getInf(), 1.0 / peaks[k].freq});
+		}
+	}
 	// Find the tones (collections of harmonics) from the array of peaks
-	tones_t tones;
+	tones_t& tones = m_newTones;
+	tones.clear();
 	for (size_t k = kMax - 1; k >= kMin; --k) {
 		if (peaks[k].db < -70.0) continue;
-		// Find the best divider for getting the fundamental from peaks[k]
-		std::size_t bestDiv = 1;
-		int bestScore = 0;
-		for (std::size_t div = 2; div <= Tone::MAXHARM && k / div > 1; ++div) {
-			double freq = peaks[k].freq / div; // Fundamental
-			double db = peaks[k].db;
-			int score = 0;
-			for (std::size_t n = 1; n < div && n < 8; ++n) {
-				Peak& p = match(peaks, k * n / div);
-				--score;
-				if (std::abs(p.db/db - 1.0) > 0.4 || std::abs(p.freq / n / freq - 1.0) > .04) continue;
-				if (n == 1) score += 1; // Extra for fundamental
-				score += 2;
-			}
-			if (score >= bestScore) {
-				bestScore = score;
-				bestDiv = div;
-			}
-		}
+		std::size_t bestDiv = findDivider(k);
 		// Construct a Tone by combining the fundamental frequency (freq) and all harmonics
 		Tone t;
 		std::size_t count = 0;
@@ -201,35 +266,159 @@ void Analyzer::calcTones() {
 			tones.push_back(t);
 		}
 	}
-	mergeWithOld(tones);
-	m_tones.swap(tones);
+	sortTones();
+	mergeWithOld();
+}
+
+void Analyzer::sortTones() {
+	// Tone::operator< is not a strict weak ordering, so the result depends on the algorithm. This is a stable bottom-up
+	// merge sort doing the same merges as std::list::sort, with m_mergedTones (cleared by mergeWithOld) as scratch.
+	tones_t& tones = m_newTones;
+	tones_t& scratch = m_mergedTones;
+	const std::size_t n = tones.size();
+	scratch.resize(n);
+	for (std::size_t width = 1; width < n; width *= 2) {
+		for (std::size_t lo = 0; lo < n; lo += 2 * width) {
+			const std::size_t mid = std::min(lo + width, n);
+			const std::size_t hi = std::min(lo + 2 * width, n);
+			std::size_t i = lo, j = mid, k = lo;
+			// Take from the right run only if strictly less (keeps equal tones in order)
+			while (i < mid && j < hi) scratch[k++] = (tones[j] < tones[i]) ? tones[j++] : tones[i++];
+			while (i < mid) scratch[k++] = tones[i++];
+			while (j < hi) scratch[k++] = tones[j++];
+		}
+		tones.swap(scratch);
+	}
 }
 
-void Analyzer::mergeWithOld(tones_t& tones) const {
-	tones.sort();
-	auto it = tones.begin();
+void Analyzer::scatterHarmonics(std::size_t k, std::uint32_t* harmonics) {
+	// Harmonic n of divider div is found if match() at pos = k * n / div picks a peak p with a level within 40 % of
+	// peaks[k] and p.freq / n within 4 % of the fundamental peaks[k].freq / div. Only the indexed peaks qualify, and each
+	// can only be picked for div / n in (k / (bin + 2), k / (bin - 1)] and [0.96, 1.04] * peaks[k].freq / p.freq, so the
+	// entries of harmonicTable() in both ranges are all that need checking.
+	std::vector<Peak>& peaks = m_peaks;
+	const std::size_t divMax = std::min(k / 2, std::size_t(Tone::MAXHARM));  // k / div > 1
+	std::fill(harmonics, harmonics + Tone::MAXHARM + 1, 0);
+	const double freq = peaks[k].freq, db = peaks[k].db;
+	if (!(freq > 0.0)) {
+		// Peaks with non-positive frequencies could match, check every harmonic
+		for (std::size_t div = 2; div <= divMax; ++div) {
+			for (std::size_t n = 1; n < div && n < 8; ++n) {
+				const std::size_t pos = k * n / div;
+				Peak const& p = match(peaks, pos);
+				if (std::abs(p.db/db - 1.0) > 0.4 || std::abs(p.freq / n / (freq / div) - 1.0) > .04) continue;
+				harmonics[div] |= std::uint32_t(1) << (3 * (n - 1) + (&p - &peaks[pos] + 1));
+			}
+		}
+		return;
+	}
+	HarmonicTable const& table = harmonicTable();
+	const double invFreq = 1.0 / freq;
+	const std::size_t binMax = k * 7 / 8 + 1;  // The largest k * n / div plus one
+	for (IndexedPeak const& ip: m_peakIndex) {
+		const std::size_t j = ip.bin;
+		if (j > binMax) break;
+		Peak const& p = peaks[j];
+		if (std::abs(p.db/db - 1.0) > 0.4) continue;  // Also skips peaks cleared meanwhile
+		// Both ranges of div / n, with some margin for rounding (the exact checks follow)
+		const double ratio = freq * ip.invFreq, invRatio = p.freq * invFreq;
+		const double lo = std::max(k * ip.invBinLo, ratio * 0.959), hi = std::min(k * ip.invBinHi, ratio * 1.041);
+		if (!(lo < Tone::MAXHARM)) continue;
+		HarmonicTable::Entry const* e = &table.entries[table.first[static_cast<unsigned>(lo * HarmonicTable::STEPS)]];
+		for (; e->ratio <= hi; ++e) {
+			const std::size_t n = e->n, div = e->div, kn = k * n;
+			if (e->ratio < lo || div > divMax) continue;
+			if (div * (j + 2) <= kn || div * (j - 1) > kn) continue;  // pos outside [j - 1, j + 1]
+			// |p.freq / n / (freq / div) - 1| * n, using that exact expression only close to the limit
+			const double dev = std::abs(div * invRatio - n);
+			if (dev > 0.0401 * n || (dev > 0.0399 * n && std::abs(p.freq / n / (freq / div) - 1.0) > .04)) continue;
+			const std::size_t pos = div * (j + 1) <= kn ? j + 1 : div * j <= kn ? j : j - 1;
+			harmonics[div] |= std::uint32_t(1) << (3 * (n - 1) + (j + 1 - pos));
+		}
+	}
+}
+
+std::size_t Analyzer::findDivider(std::size_t k) {
+	// Each divider div scores the harmonics n < div (n < 8) found at k * n / div
+	std::vector<Peak>& peaks = m_peaks;
+	const std::size_t divMax = std::min(k / 2, std::size_t(Tone::MAXHARM));  // k / div > 1
+	std::uint32_t harmonics[Tone::MAXHARM + 1];
+	scatterHarmonics(k, harmonics);
+	std::size_t bestDiv = 1;
+	int bestScore = 0;
+	for (std::size_t div = 2; div <= divMax; ++div) {
+		const std::size_t nMax = std::min<std::size_t>(div - 1, 7);
+		const std::uint32_t mask = harmonics[div];
+		int score = -static_cast<int>(nMax);  // Every harmonic that is not found costs a point
+		for (std::size_t n = 1; n <= nMax; ++n) {
+			const std::uint32_t found = mask >> (3 * (n - 1)) & 7;  // Bit 1 + (peak - pos) for each matching peak
+			if (!found) continue;
+			const std::size_t pos = k * n / div;
+			if (!(found >> (&match(peaks, pos) - &peaks[pos] + 1) & 1)) continue;  // match() picks another peak
+			score += (n == 1 ? 3 : 2);  // Extra for fundamental
+		}
+		if (score >= bestScore) {
+			bestScore = score;
+			bestDiv = div;
+		}
+	}
+	return bestDiv;
+}
+
+void Analyzer::mergeWithOld() {
+	tones_t& merged = m_mergedTones;
+	merged.clear();
+	auto it = m_newTones.begin();
 	// Iterate over old tones
 	for (auto const& old: m_tones) {
 		// Try to find a matching new tone
-		while (it != tones.end() && *it < old) ++it;
+		while (it != m_newTones.end() && *it < old) merged.push_back(*it++);
 		// If match found
-		if (it != tones.end() && *it == old) {
+		if (it != m_newTones.end() && *it == old) {
 			// Merge the old tone into the new tone
 			it->age = old.age + 1;
 			it->stabledb = 0.8 * old.stabledb + 0.2 * it->db;
 			it->freq = 0.5 * old.freq + 0.5 * it->freq;
 		} else if (old.db > -80.0) {
 			// Insert a decayed version of the old tone into new tones
-			Tone& t = *tones.insert(it, old);
+			merged.push_back(old);
+			Tone& t = merged.back();
 			t.db -= 5.0;
 			t.stabledb -= 0.1;
 		}
 	}
+	merged.insert(merged.end(), it, m_newTones.end());
+	m_tones.swap(merged);
+}
+
+void Analyzer::skipBacklog(size_t keepWindows) {
+	size_t windows = windowsAvailable();
+	if (windows <= keepWindows) return;
+	// The phase difference to the previous window is needed for the frequencies, so the window right before the kept ones
+	// is not skipped but only used to update the phases
+	size_t skip = windows - keepWindows - 1;
+	popSamples(skip * m_step);
+	m_peak *= std::pow(0.999, double(skip * m_step));  // Decay like calcFFT does, ignoring the skipped samples
+	if (!calcFFT()) return;
+	const size_t kMax = std::min(m_fftSize / 2, size_t(FFT_MAXFREQ / (m_rate / m_fftSize)));
+	calcSpectrum(kMax);
+	// Tones fade out as if no new tones were found in the windows not analyzed (all are gone after 17 windows anyway)
+	m_newTones.clear();
+	for (size_t i = 0; i < std::min<size_t>(skip + 1, 20) && !m_tones.empty(); ++i) mergeWithOld();
 }
 
 void Analyzer::process() {
+	if (m_maxWindows) skipBacklog(m_maxWindows);
+	auto start = std::chrono::steady_clock::now();
 	// Try calculating FFT and calculate tones until no more data in input buffer
-	while (calcFFT()) calcTones();
+	while (calcFFT()) {
+		calcTones();
+		if (m_maxMicros && std::chrono::steady_clock::now() - start > std::chrono::microseconds(m_maxMicros)) {
+			// Out of time: Drop what is left, it would only be older the next time
+			skipBacklog(0);
+			break;
+		}
+	}
 }
 
 
@@ -2,10 +2,14 @@
 
 #include <complex>
 #include <vector>
-#include <list>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
 #include <cmath>
+#include <cstdint>
 #include "../compatibility.h"
+#include "../Helper.h"
 
 /// struct to represent tones
 struct Tone {
@@ -30,58 +34,136 @@ static inline bool operator>=(Tone const& lhs, Tone const& rhs) { return lhs.fre
 static inline bool operator<(Tone const& lhs, Tone const& rhs) { return lhs.freq < rhs.freq && lhs != rhs; }
 static inline bool operator>(Tone const& lhs, Tone const& rhs) { return lhs.freq > rhs.freq && lhs != rhs; }
 
-static const unsigned FFT_P = 10;
+static const unsigned FFT_P = 10;  ///< Default FFT order
 static const std::size_t FFT_N = 1 << FFT_P;
 
-/// Lock-free ring buffer. Discards oldest data on overflow (not strictly thread-safe).
+/// Lock-free single-producer/single-consumer ring buffer. Discards oldest data on overflow.
+/** One thread may insert while another one reads and pops. Indices run freely and are only masked when accessing the
+ *  storage. The producer never touches the read index: If it overwrites data that was not consumed yet, the consumer
+ *  notices this itself, skips the lost samples and retries reads that raced with the overwrite.
+ */
 template <size_t SIZE> class RingBuffer {
+	static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "RingBuffer size must be a power of two");
 public:
 	constexpr static size_t capacity = SIZE;
-	RingBuffer(): m_read(), m_write() {}  ///< Initialize empty buffer
+	RingBuffer(): m_read(0), m_write(0), m_writeEnd(0) {}  ///< Initialize empty buffer
+	/// Insert data (producer side)
 	template <typename InIt> void insert(InIt begin, InIt end) {
-		size_t r = m_read;  // The read position
-		size_t w = m_write;  // The write position
-		bool overflow = (static_cast<size_t>(end - begin) >= SIZE - size());
-		while (begin != end) {
-			m_buf[w] = *begin++;  // Copy sample
-			w = modulo(w + 1);  // Update cursor
-		}
-		m_write = w;
-		if (overflow) m_read = modulo(w + 1);  // Reset read pointer on overflow
+		write(static_cast<size_t>(end - begin), [begin](float* dst, size_t offset, size_t n) { std::copy(begin + offset, begin + offset + n, dst); });
+	}
+	/// Convert signed 16 bit samples to float and insert them without any intermediate buffer (producer side)
+	void insertShort(short const* begin, short const* end) {
+		write(static_cast<size_t>(end - begin), [begin](float* dst, size_t offset, size_t n) { short2Float(begin + offset, dst, n); });
 	}
+	/// Where the samples of a write go, see beginWrite
+	struct WriteSpans {
+		float* first;  ///< Storage for the samples [skip, skip + firstCount) of the write
+		size_t firstCount;
+		float* second;  ///< Storage for the samples [skip + firstCount, skip + firstCount + secondCount)
+		size_t secondCount;
+		size_t skip;  ///< Samples at the start that are not stored (only the newest SIZE ones of a write fit)
+		size_t end;  ///< Write position after the write
+	};
+	/// Insert n samples in two steps (producer side), e.g. to fill several buffers in one pass over the input:
+	/// Store the samples in the returned spans, then publish them with commitWrite. Works like insert otherwise.
+	WriteSpans beginWrite(size_t n) {
+		const size_t w = m_write.load(std::memory_order_relaxed);
+		WriteSpans spans;
+		spans.skip = n > SIZE ? n - SIZE : 0;
+		spans.end = w + n;
+		// Announce the range first so readers can detect that we are overwriting what they copy
+		m_writeEnd.store(w + n, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		size_t pos = (w + spans.skip) & MASK;
+		spans.first = m_buf + pos;
+		spans.firstCount = std::min(n - spans.skip, SIZE - pos);
+		spans.second = m_buf;
+		spans.secondCount = n - spans.skip - spans.firstCount;
+		return spans;
+	}
+	void commitWrite(WriteSpans const& spans) { m_write.store(spans.end, std::memory_order_release); }
 	/// Read data from current position if there is enough data to fill the range (otherwise return false). Does not move read pointer.
 	template <typename OutIt> bool read(OutIt begin, OutIt end) {
+		const size_t n = static_cast<size_t>(end - begin);
+		for (;;) {
+			size_t r = skipOverwritten();
+			if (m_write.load(std::memory_order_acquire) - r < n) return false;  // Not enough audio available
+			size_t pos = r & MASK;
+			size_t first = std::min(n, SIZE - pos);
+			std::copy(m_buf + pos, m_buf + pos + first, begin);
+			std::copy(m_buf, m_buf + (n - first), begin + first);
+			// Only keep the copy if the producer did not start overwriting the range meanwhile
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_writeEnd.load(std::memory_order_relaxed) - r <= SIZE) return true;
+		}
+	}
+	/// Move reading pointer forward.
+	void pop(size_t n) {
+		size_t r = skipOverwritten();
+		m_read = r + std::min(n, m_write.load(std::memory_order_acquire) - r);
+	}
+	/// Stream position of the data the last successful read() started at (samples consumed or skipped since creation). Consumer only.
+	size_t position() const { return m_read; }
+	size_t size() const {
+		size_t writeEnd = m_writeEnd.load(std::memory_order_acquire);  // Must be loaded before m_write
 		size_t r = m_read;
-		if (size() < static_cast<size_t>(end - begin)) return false;  // Not enough audio available
-		while (begin != end) *begin++ = m_buf[r++ % SIZE];  // Copy audio to output iterator
-		return true;
+		if (writeEnd - r > SIZE) r = writeEnd - SIZE;
+		return m_write.load(std::memory_order_acquire) - r;
 	}
-	void pop(size_t n) { m_read = modulo(m_read + n); } ///< Move reading pointer forward.
-	size_t size() const { return modulo(m_write - m_read); }
 private:
-	static size_t modulo(size_t idx) { return idx % SIZE; }  ///< Modulo operation with proper rounding (handles slightly "negative" idx as well)
+	static constexpr size_t MASK = SIZE - 1;
+	/// Store n samples supplied by fill(dst, offset, count) in at most two contiguous spans and publish them
+	template <typename Fill> void write(size_t n, Fill fill) {
+		// Only the newest SIZE samples can survive this call, the others are skipped but still advance the position
+		WriteSpans spans = beginWrite(n);
+		fill(spans.first, spans.skip, spans.firstCount);
+		fill(spans.second, spans.skip + spans.firstCount, spans.secondCount);
+		commitWrite(spans);
+	}
+	/// Move the read index past samples the producer has (or is about to have) overwritten (consumer side)
+	size_t skipOverwritten() {
+		size_t writeEnd = m_writeEnd.load(std::memory_order_acquire);
+		if (writeEnd - m_read > SIZE) m_read = writeEnd - SIZE;
+		return m_read;
+	}
 	float m_buf[SIZE];
-	volatile size_t m_read, m_write;  ///< The indices of the next read/write operations. read == write implies that buffer is empty.
+	size_t m_read;  ///< Position of the next read, only used by the consumer.
+	std::atomic<size_t> m_write;  ///< Position of the next write. read == write implies that buffer is empty.
+	std::atomic<size_t> m_writeEnd;  ///< End of the write in progress (equals m_write when idle).
 };
 
 /// analyzer class
  /** class to analyze input audio and transform it into useable data
+ *  The FFT size is a template parameter of the implementation (FFTAnalyzer), use create() to choose it at runtime.
+ *  Only the input buffer and the FFT (calcFFT) are compiled per size. The spectrum and tone search stay in Analyzer using
+ *  m_fftSize, their loops run over the bins below FFT_MAXFREQ which depend on the sample rate anyway.
  */
 class Analyzer {
 public:
 	/// fast fourier transform vector
 	typedef std::vector<std::complex<float> > fft_t;
-	/// list of tones
-	typedef std::list<Tone> tones_t;
-	/// constructor
-	Analyzer(double rate, std::string id, unsigned step = 200);
+	/// list of tones, sorted by frequency
+	typedef std::vector<Tone> tones_t;
+	/** Create an analyzer using FFTs of fftSize samples (512, 1024, 2048 or 4096). Throws std::invalid_argument for other sizes. **/
+	static std::unique_ptr<Analyzer> create(double rate, std::string id, unsigned step = 200, std::size_t fftSize = FFT_N);
+	virtual ~Analyzer() {}
 	/** Add input data to buffer. This is thread-safe (against other functions). **/
-	template <typename InIt> void input(InIt begin, InIt end) {
-		m_buf.insert(begin, end);
+	void input(float const* begin, float const* end) {
+		insert(begin, end);
 		m_passthrough.insert(begin, end);
 	}
+	/** Add signed 16 bit input data to buffer, converting it on the fly. **/
+	void inputShort(short const* begin, short const* end) {
+		insertShort(begin, end);
+		m_passthrough.insertShort(begin, end);
+	}
 	/** Call this to process all data input so far. **/
 	void process();
+	/** Limit the work of process() when a lot of input piled up (e.g. after a hitch of the caller): Only the newest maxWindows
+	    windows are analyzed and the analysis stops after about maxMicros microseconds, dropping the rest. 0 means no limit. **/
+	void setBacklogPolicy(unsigned maxWindows, unsigned maxMicros) { m_maxWindows = maxWindows; m_maxMicros = maxMicros; }
+	/** Number of samples per FFT **/
+	std::size_t getFFTSize() const { return m_fftSize; }
 	/** Get the raw FFT. **/
 	fft_t const& getFFT() const { return m_fft; }
 	/** Get the peak level in dB (negative value, 0.0 = clipping). **/
@@ -107,26 +189,84 @@ public:
 		m_oldfreq = (best ? best->freq : 0.0);
 		return best;
 	}
-	/** Give data away for mic pass-through */
-	bool output(float* begin, float* end, double rate);
+	/** Give data away for mic pass-through (added to the interleaved stereo samples in [begin, end) with the given gains) */
+	bool output(float* begin, float* end, double rate, float gainLeft = 1.0f, float gainRight = 1.0f);
 	/** Returns the id (color name) of the mic */
 	std::string const& getId() const { return m_id; }
 
-private:
+protected:
+	Analyzer(double rate, std::string id, unsigned step, std::size_t fftSize);
 	const unsigned m_step;
-	RingBuffer<4 * FFT_N> m_buf;  // Twice the FFT size should give enough room for sliding window and for engine delays
+	const std::size_t m_fftSize;
+	std::vector<float> m_window;
+	fft_t m_fft;
+	double m_peak;
+
+private:
+	/// Add input to the FFT buffer
+	virtual void insert(float const* begin, float const* end) = 0;
+	virtual void insertShort(short const* begin, short const* end) = 0;
+	/// Calculate the FFT of the next window into m_fft (false if there is no complete window)
+	virtual bool calcFFT() = 0;
+	/// Number of complete windows in the input buffer
+	virtual size_t windowsAvailable() const = 0;
+	/// Drop samples from the input buffer
+	virtual void popSamples(size_t count) = 0;
 	RingBuffer<4096> m_passthrough;
 	double m_resampleFactor;
 	double m_resamplePos;
 	double m_rate;
 	std::string m_id;
-	std::vector<float> m_window;
-	fft_t m_fft;
 	std::vector<float> m_fftLastPhase;
-	double m_peak;
+	std::vector<float> m_expectedPhase;  ///< Phase advance of each bin's center frequency per step (mod pi)
 	tones_t m_tones;
+	// Scratch buffers of calcTones, allocated once so that process() does not touch the heap
+	struct Peak {
+		double freq;
+		double db;
+		void clear();
+	};
+	std::vector<Peak> m_peaks;
+	struct IndexedPeak {
+		std::size_t bin;
+		double invBinLo, invBinHi;  ///< 1 / (bin + 2) and 1 / (bin - 1) (with margin)
+		double invFreq;
+	};
+	std::vector<IndexedPeak> m_peakIndex;  ///< The peaks left after prefiltering with a positive frequency, ascending
+	std::vector<float> m_binFreq;
+	std::vector<float> m_binDb;
+	tones_t m_newTones;
+	tones_t m_mergedTones;
 	mutable double m_oldfreq;
-	bool calcFFT();
+	unsigned m_maxWindows;
+	unsigned m_maxMicros;
+	/// Update m_fftLastPhase and calculate m_binFreq and m_binDb for the bins 1..kMax
+	void calcSpectrum(size_t kMax);
+	/// Drop all but the newest keepWindows windows, keeping phases and tones consistent
+	void skipBacklog(size_t keepWindows);
 	void calcTones();
-	void mergeWithOld(tones_t& tones) const;
+	static Peak& match(std::vector<Peak>& peaks, std::size_t pos);
+	/// Set bit 3 * (n - 1) + 1 + (peak - pos) of harmonics[div] for each peak around pos = k * n / div matching harmonic n
+	void scatterHarmonics(std::size_t k, std::uint32_t* harmonics);
+	/// Find the best divider for getting the fundamental from m_peaks[k]
+	std::size_t findDivider(std::size_t k);
+	/// Sort m_newTones by frequency like std::list::sort would
+	void sortTones();
+	/// Merge m_newTones (sorted) with the old tones into m_tones
+	void mergeWithOld();
+};
+
+/// Analyzer using FFTs of 2^P samples (P only fixes the buffer sizes and the FFT, see Analyzer)
+template <unsigned P> class FFTAnalyzer: public Analyzer {
+public:
+	static constexpr std::size_t N = std::size_t(1) << P;
+	FFTAnalyzer(double rate, std::string id, unsigned step = 200): Analyzer(rate, id, step, N) {}
+
+private:
+	void insert(float const* begin, float const* end) override { m_buf.insert(begin, end); }
+	void insertShort(short const* begin, short const* end) override { m_buf.insertShort(begin, end); }
+	bool calcFFT() override;
+	size_t windowsAvailable() const override;
+	void popSamples(size_t count) override { m_buf.pop(count); }
+	RingBuffer<4 * N> m_buf;  // Twice the FFT size should give enough room for sliding window and for engine delays
 };
@@ -15,7 +15,12 @@
 
 #define _USE_MATH_DEFINES
 #include "ptAKF.h"
+#include "SimdKernels.h"
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
 
 #ifdef USE_FFT
 #include "FFT/FFT.h"
@@ -24,80 +29,385 @@
 static constexpr double BaseToneFrequency = 65.4064; // lowest (half-)tone to analyze (C2 = 65.4064 Hz)
 static constexpr double HalftoneBase = 1.05946309436; // 2^(1/12) -> HalftoneBase^12 = 2 (one octave)
 
-template<typename T>
-T abs_template(T t)
-{
-	return t>0 ? t : -t;
-}
-
-int PtAKF::_InitCount = 0;
-float* restrict PtAKF::_SamplesPerPeriodPerTone = NULL;
-float* restrict PtAKF::_SamplesPerPeriodPerToneFine = NULL;
-float* restrict PtAKF::_Window = NULL;
+// Tables shared by all instances with the same configuration
+struct SAKFTables{
+	double sampleRate;
+	int minHalfTone, toneCt;
+	size_t sampleCt;
+	std::vector<float> samplesPerPeriodPerTone;
+	std::vector<float> samplesPerPeriodPerToneFine;
+	std::vector<float> window;
+};
 
 double GetFrequencyFromTone(double toneIndex){
 	return BaseToneFrequency * pow(HalftoneBase, toneIndex);
 }
 
-PtAKF::PtAKF(unsigned step){
-	_InitCount++;
-	if(_InitCount == 1){
-		_SamplesPerPeriodPerTone = new float[_MaxHalfTone + 1 + _HalfTonesAdd];
-		_SamplesPerPeriodPerToneFine = new float[(_MaxHalfTone + 1 + _HalfTonesAdd) * 2];
-		//Init Array to avoid costly calculations
-		for (int toneIndex = 0; toneIndex <= _MaxHalfTone + _HalfTonesAdd; toneIndex++)
-		{
-			_SamplesPerPeriodPerTone[toneIndex] = static_cast<float>(44100.0 / GetFrequencyFromTone(toneIndex)); // samples in one period
-			_SamplesPerPeriodPerToneFine[2 * toneIndex] = static_cast<float>(44100.0 / GetFrequencyFromTone(toneIndex - 1./3.)); // samples for a bit below exact frequency
-			_SamplesPerPeriodPerToneFine[2 * toneIndex + 1] = static_cast<float>(44100.0 / GetFrequencyFromTone(toneIndex + 1./3.)); // samples for a bit above exact frequency
-		}
-		_Window = new float[_SampleCt];
-		double cosMult = 2. * M_PI / (2 * _SampleCt - 1.); //To simplify and speed up; 2 * _SampleCt because we extend the data by a factor of 2
-		for (int i = 0; i < _SampleCt; i++) {
-			_Window[i] = static_cast<float>(0.54 - 0.46 * cos(i * cosMult));
+static std::shared_ptr<const SAKFTables> GetTables(double sampleRate, int minHalfTone, int toneCt, size_t sampleCt){
+	static std::mutex mutex;
+	static std::vector<std::weak_ptr<const SAKFTables>> cache; // Tables are freed when the last instance using them is gone
+	std::lock_guard<std::mutex> lock(mutex);
+	for(auto it = cache.begin(); it != cache.end();){
+		std::shared_ptr<const SAKFTables> tables = it->lock();
+		if(!tables){
+			it = cache.erase(it);
+			continue;
 		}
+		if(tables->sampleRate == sampleRate && tables->minHalfTone == minHalfTone && tables->toneCt == toneCt && tables->sampleCt == sampleCt)
+			return tables;
+		++it;
+	}
+
+	std::shared_ptr<SAKFTables> tables = std::make_shared<SAKFTables>();
+	tables->sampleRate = sampleRate;
+	tables->minHalfTone = minHalfTone;
+	tables->toneCt = toneCt;
+	tables->sampleCt = sampleCt;
+	tables->samplesPerPeriodPerTone.resize(toneCt);
+	tables->samplesPerPeriodPerToneFine.resize(toneCt * 2);
+	//Init Array to avoid costly calculations
+	for (int toneIndex = 0; toneIndex < toneCt; toneIndex++)
+	{
+		int halfTone = minHalfTone + toneIndex;
+		tables->samplesPerPeriodPerTone[toneIndex] = static_cast<float>(sampleRate / GetFrequencyFromTone(halfTone)); // samples in one period
+		tables->samplesPerPeriodPerToneFine[2 * toneIndex] = static_cast<float>(sampleRate / GetFrequencyFromTone(halfTone - 1./3.)); // samples for a bit below exact frequency
+		tables->samplesPerPeriodPerToneFine[2 * toneIndex + 1] = static_cast<float>(sampleRate / GetFrequencyFromTone(halfTone + 1./3.)); // samples for a bit above exact frequency
+	}
+	tables->window.resize(sampleCt);
+	double cosMult = 2. * M_PI / (2 * sampleCt - 1.); //To simplify and speed up; 2 * _SampleCt because we extend the data by a factor of 2
+	for (size_t i = 0; i < sampleCt; i++) {
+		tables->window[i] = static_cast<float>(0.54 - 0.46 * cos(i * cosMult));
 	}
+	cache.push_back(tables);
+	return tables;
+}
+
+PtAKF::PtAKF(unsigned step, double sampleRate, int minHalfTone, int maxHalfTone, size_t sampleCt){
+	if(sampleCt < _MinSampleCt || sampleCt > _MaxSampleCt || (sampleCt & (sampleCt - 1)) != 0)
+		throw std::invalid_argument("PtAKF: Window size must be a power of 2 between 256 and 4096");
+	if(step == 0 || step > sampleCt)
+		throw std::invalid_argument("PtAKF: Step must be between 1 and the window size");
+	if(!(sampleRate > 0.) || minHalfTone < 0 || maxHalfTone < minHalfTone)
+		throw std::invalid_argument("PtAKF: Invalid sample rate or tone range");
+	// The window has to contain at least 2 periods of the lowest tone and the highest one (incl. the additional ones) needs some samples per period
+	if(sampleRate / GetFrequencyFromTone(minHalfTone - 1./3.) > sampleCt / 2 || sampleRate / GetFrequencyFromTone(maxHalfTone + _HalfTonesAdd + 1./3.) < 2.)
+		throw std::invalid_argument("PtAKF: Tone range does not fit the window size and sample rate");
+
+	_MinHalfTone = minHalfTone;
+	_MaxTone = maxHalfTone - minHalfTone;
+	_SampleCt = sampleCt;
+	_Tables = GetTables(sampleRate, _MinHalfTone, _MaxTone + 1 + _HalfTonesAdd, _SampleCt);
+	_SamplesPerPeriodPerTone = _Tables->samplesPerPeriodPerTone.data();
+	_SamplesPerPeriodPerToneFine = _Tables->samplesPerPeriodPerToneFine.data();
+	_Window = _Tables->window.data();
+
+	_Samples.resize(_SampleCt);
+	_SamplesWindowed.resize(_SampleCt);
+	_ToneAKF.resize(_MaxTone + 1);
+	_WeightExact.resize(_MaxTone + 1);
+#ifdef USE_FFT
+	_FFTPlan.reset(new FFTPlan(static_cast<int>(_SampleCt * 2)));
+	_MaxLag = static_cast<int>(_SamplesPerPeriodPerToneFine[0]) + 1; // Longest period is the fine one below the lowest tone, +1 for interpolation
+	_AKFValues.resize(_MaxLag + 1);
+#endif
 	_Step = step;
 	_VolTreshold = 0.01f;
 	_LastMaxVol = 0.f;
+	_PeakGuided = false;
+	_MaxWindows = 0;
+	_MaxMicros = 0;
+#ifdef USE_FFT
+	_Sliding = step <= _SampleCt / _SlidingStepRatio;
+	_WindowPosition = 0;
+	_AKFPending = false;
+	// Only the tones are tracked, the fine periods are only needed around a few peaks and calculated directly
+	std::vector<int> lags = {0, 1}; // The energy (lag 0) is interpolated like the others
+	std::vector<float> periods;
+	for(int toneIndex = 0; toneIndex <= _MaxTone + _HalfTonesAdd; toneIndex++){
+		float samplesPerPeriod = _SamplesPerPeriodPerTone[toneIndex];
+		lags.push_back(static_cast<int>(samplesPerPeriod));
+		lags.push_back(static_cast<int>(samplesPerPeriod) + 1);
+		periods.push_back(samplesPerPeriod);
+	}
+	_SlidingAKF.Init(_FFTPlan.get(), _SampleCt, 0.54, 0.46, 2. * M_PI / (2 * _SampleCt - 1.), lags, periods);
+#else
+	_Sliding = false;
+#endif
 	for(int i = 0; i < _SmoothCt; i++)
 		_LastTones[i] = -1;
 	_LastToneIndex = 0;
+	_BatchState = BATCH_IDLE;
+	_WindowPending = false;
+	_BatchWeights = NULL;
+	_Worker.store(NULL, std::memory_order_relaxed);
+	_Notifying.store(0, std::memory_order_relaxed);
+	_WorkerThread = 0;
+	_InputPending.store(false, std::memory_order_relaxed);
+	_OwnWeights.resize(GetToneCount());
+	_SnapshotWeights.resize(GetToneCount());
+	_SnapshotRead.resize(GetToneCount());
+	_Snapshot.Resize(GetToneCount());
+	_SnapshotSeen = 0;
+	_SnapshotLastTone = -1;
+	_SnapshotMaxVolume = 0.f;
 }
 
 PtAKF::~PtAKF(){
-	_InitCount--;
-	if(!_InitCount){
-		delete[] _SamplesPerPeriodPerTone;
-		_SamplesPerPeriodPerTone = NULL;
-		delete[] _SamplesPerPeriodPerToneFine;
-		_SamplesPerPeriodPerToneFine = NULL;
-	}
+	PitchWorker* worker = _Worker.load(std::memory_order_acquire);
+	if(worker)
+		worker->Remove(this);
 }
 
 void PtAKF::SetVolumeThreshold(float threshold){
 	_VolTreshold = threshold;
 }
 
+void PtAKF::SetSlidingWindow(bool enabled){
+#ifdef USE_FFT
+	_Sliding = enabled;
+	_SlidingAKF.Reset();
+#endif
+}
+
 int PtAKF::GetNote(float* restrict maxVolume, float* restrict weights){
-	float AnaylsisBuf[_SampleCt];
-	int note = _LastTones[_LastToneIndex];
-	if(_AnalysisBuf.read(AnaylsisBuf, AnaylsisBuf + _SampleCt)){
-		do{
-			_AnalysisBuf.pop(_Step);
-			note = _GetNote(AnaylsisBuf, maxVolume, weights);
-			if(++_LastToneIndex >= _SmoothCt)
-				_LastToneIndex = 0;
-			_LastTones[_LastToneIndex] = note;
-		}while(_AnalysisBuf.read(AnaylsisBuf, AnaylsisBuf + _SampleCt));
-		note = _GetSmoothTone();
-		_LastMaxVol = *maxVolume;
-	}else{
-		*maxVolume = _LastMaxVol * 0.85f;
+	if(_Worker.load(std::memory_order_acquire))
+		return _GetBackgroundNote(maxVolume, weights);
+	PtAKF* self = this;
+	int note;
+	_AnalyzeNotes(&self, 1, &note, maxVolume, weights);
+	return note;
+}
+
+void PtAKF::GetNotes(PtAKF* const* trackers, int count, int* notes, float* maxVolumes, float* weights){
+	// Only the trackers without a worker can be analyzed together, so analyze the runs of them between the others
+	int first = 0;
+	float* firstWeights = weights;
+	for(int i = 0; i <= count; i++){
+		if(i < count && !trackers[i]->_Worker.load(std::memory_order_acquire)){
+			weights += trackers[i]->GetToneCount();
+			continue;
+		}
+		if(i > first)
+			_AnalyzeNotes(trackers + first, i - first, notes + first, maxVolumes + first, firstWeights);
+		if(i < count){
+			notes[i] = trackers[i]->_GetBackgroundNote(&maxVolumes[i], weights);
+			weights += trackers[i]->GetToneCount();
+		}
+		first = i + 1;
+		firstWeights = weights;
 	}
+}
+
+bool PtAKF::InputInterleaved(PtAKF* const* trackers, int channelCount, const short* frames, size_t frameCount){
+	if(channelCount < 1 || channelCount > MaxInterleavedChannels)
+		return false;
+	// All buffers get the same amount, only the positions where they wrap around differ
+	RingBuffer<_MaxSampleCt * 2>::WriteSpans spans[MaxInterleavedChannels];
+	size_t skip = 0;
+	for(int c = 0; c < channelCount; c++){
+		if(!trackers[c])
+			continue;
+		spans[c] = trackers[c]->_AnalysisBuf.beginWrite(frameCount);
+		skip = spans[c].skip;
+	}
+	// Convert in segments between the wrap-around positions
+	float* out[MaxInterleavedChannels];
+	for(size_t frame = skip; frame < frameCount;){
+		size_t segmentEnd = frameCount;
+		for(int c = 0; c < channelCount; c++){
+			if(!trackers[c]){
+				out[c] = NULL;
+				continue;
+			}
+			size_t wrap = spans[c].skip + spans[c].firstCount;
+			if(frame < wrap){
+				out[c] = spans[c].first + (frame - spans[c].skip);
+				segmentEnd = std::min(segmentEnd, wrap);
+			}else
+				out[c] = spans[c].second + (frame - wrap);
+		}
+		SimdDeinterleaveShort2Float(frames + frame * channelCount, channelCount, out, segmentEnd - frame);
+		frame = segmentEnd;
+	}
+	for(int c = 0; c < channelCount; c++){
+		if(!trackers[c])
+			continue;
+		trackers[c]->_AnalysisBuf.commitWrite(spans[c]);
+		trackers[c]->_NotifyWorker();
+	}
+	return true;
+}
+
+void PtAKF::AnalyzeToResults(PtAKF* const* trackers, int count, SNoteResult* results){
+	// Analyze the trackers without a worker in groups that share the autocorrelation pass
+	PtAKF* batch[_BatchSize];
+	SNoteResult* batchResults[_BatchSize];
+	int batchCt = 0;
+	auto analyzeBatch = [&](){
+		int notes[_BatchSize];
+		float maxVolumes[_BatchSize];
+		_AnalyzeNotes(batch, batchCt, notes, maxVolumes, NULL);
+		for(int j = 0; j < batchCt; j++){
+			batchResults[j]->note = notes[j];
+			batchResults[j]->maxVolume = maxVolumes[j];
+		}
+		batchCt = 0;
+	};
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		if(tracker->_Worker.load(std::memory_order_acquire)){
+			// _OwnWeights belongs to the worker
+			results[i].note = tracker->_GetBackgroundNote(&results[i].maxVolume, tracker->_SnapshotWeights.data());
+			continue;
+		}
+		batch[batchCt] = tracker;
+		batchResults[batchCt++] = &results[i];
+		if(batchCt == _BatchSize)
+			analyzeBatch();
+	}
+	if(batchCt > 0)
+		analyzeBatch();
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		const std::vector<float>& weights = tracker->_Worker.load(std::memory_order_acquire) ? tracker->_SnapshotWeights : tracker->_OwnWeights;
+		int toneCt = std::min(tracker->GetToneCount(), static_cast<int>(SNoteResult::ResultTones));
+		std::copy(weights.begin(), weights.begin() + toneCt, results[i].weights);
+		std::fill(results[i].weights + toneCt, results[i].weights + SNoteResult::ResultTones, 0.f);
+	}
+}
+
+void PtAKF::_NotifyWorker(){
+	// Announce the use first, so _DetachWorker either sees it or this sees _Worker cleared (sequentially consistent)
+	_Notifying.fetch_add(1, std::memory_order_seq_cst);
+	PitchWorker* worker = _Worker.load(std::memory_order_seq_cst);
+	if(worker){
+		_InputPending.store(true, std::memory_order_release);
+		worker->_Notify(_WorkerThread);
+	}
+	_Notifying.fetch_sub(1, std::memory_order_release);
+}
+
+void PtAKF::_DetachWorker(){
+	_Worker.store(NULL, std::memory_order_seq_cst);
+	while(_Notifying.load(std::memory_order_seq_cst) != 0)
+		std::this_thread::yield();
+}
+
+void PtAKF::_AnalyzeInBackground(){
+	PtAKF* self = this;
+	int note;
+	float maxVolume;
+	_AnalyzeNotes(&self, 1, &note, &maxVolume, NULL);
+	if(_BatchState != BATCH_IDLE)
+		_Snapshot.Publish(note, _LastTones[_LastToneIndex], maxVolume, _OwnWeights.data());
+}
+
+int PtAKF::_GetBackgroundNote(float* maxVolume, float* weights){
+	if(_Snapshot.GetVersion() == _SnapshotSeen){
+		// Nothing new, same as _AnalyzeNotes without a window
+		*maxVolume = _SnapshotMaxVolume * 0.85f;
+		return _SnapshotLastTone;
+	}
+	int note, lastTone;
+	float volume;
+	if(!_Snapshot.Read(&_SnapshotSeen, &note, &lastTone, &volume, _SnapshotRead.data())){
+		// The worker kept publishing meanwhile: Keep the last good result (next time there is a new one anyway)
+		*maxVolume = _SnapshotMaxVolume * 0.85f;
+		return _SnapshotLastTone;
+	}
+	std::copy(_SnapshotRead.begin(), _SnapshotRead.end(), weights);
+	_SnapshotLastTone = lastTone;
+	_SnapshotMaxVolume = *maxVolume = volume;
 	return note;
 }
 
+void PtAKF::_AnalyzeNotes(PtAKF* const* trackers, int count, int* notes, float* maxVolumes, float* weights){
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		notes[i] = tracker->_LastTones[tracker->_LastToneIndex];
+		if(tracker->_MaxWindows)
+			tracker->_SkipBacklog(tracker->_MaxWindows);
+	}
+	auto start = std::chrono::steady_clock::now();
+	bool running = false;
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		if(weights){
+			tracker->_BatchWeights = weights;
+			weights += tracker->GetToneCount();
+		}else
+			tracker->_BatchWeights = tracker->_OwnWeights.data();
+		float* samples = tracker->_Samples.data();
+		tracker->_BatchState = tracker->_AnalysisBuf.read(samples, samples + tracker->_SampleCt) ? BATCH_RUNNING : BATCH_IDLE;
+		if(tracker->_BatchState == BATCH_RUNNING)
+			running = true;
+	}
+	// Analyze one window of every tracker per round, so the autocorrelations can be done together
+	while(running){
+		for(int i = 0; i < count; i++){
+			PtAKF* tracker = trackers[i];
+			if(tracker->_BatchState != BATCH_RUNNING)
+				continue;
+#ifdef USE_FFT
+			tracker->_WindowPosition = tracker->_AnalysisBuf.position();
+#endif
+			tracker->_AnalysisBuf.pop(tracker->_Step);
+			tracker->_WindowPending = tracker->_BeginWindow(tracker->_Samples.data(), &maxVolumes[i]);
+		}
+#ifdef USE_FFT
+		_CalcAutocorrelations(trackers, count);
+#endif
+		running = false;
+		for(int i = 0; i < count; i++){
+			PtAKF* tracker = trackers[i];
+			if(tracker->_BatchState != BATCH_RUNNING)
+				continue;
+			float* samples = tracker->_Samples.data();
+			int note = tracker->_WindowPending ? tracker->_FinishWindow(samples, tracker->_BatchWeights) : -1;
+			if(++tracker->_LastToneIndex >= _SmoothCt)
+				tracker->_LastToneIndex = 0;
+			tracker->_LastTones[tracker->_LastToneIndex] = note;
+			if(tracker->_MaxMicros && std::chrono::steady_clock::now() - start > std::chrono::microseconds(tracker->_MaxMicros))
+				tracker->_BatchState = BATCH_OUT_OF_TIME;
+			else if(!tracker->_AnalysisBuf.read(samples, samples + tracker->_SampleCt))
+				tracker->_BatchState = BATCH_DONE;
+			else
+				running = true;
+		}
+	}
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		if(tracker->_BatchState == BATCH_IDLE){
+			maxVolumes[i] = tracker->_LastMaxVol * 0.85f;
+			continue;
+		}
+		notes[i] = tracker->_GetSmoothTone();
+		tracker->_LastMaxVol = maxVolumes[i];
+		// Drop what is left, it would only be older the next time
+		if(tracker->_BatchState == BATCH_OUT_OF_TIME)
+			tracker->_SkipBacklog(0);
+	}
+}
+
+size_t PtAKF::_WindowsAvailable(){
+	size_t size = _AnalysisBuf.size();
+	return (size < _SampleCt) ? 0 : (size - _SampleCt) / _Step + 1;
+}
+
+void PtAKF::_SkipBacklog(size_t keepWindows){
+	size_t windows = _WindowsAvailable();
+	if(windows <= keepWindows)
+		return;
+	size_t skip = windows - keepWindows;
+	_AnalysisBuf.pop(skip * _Step);
+	// The tones of the skipped windows are unknown, so they must not count for the smoothing
+	for(size_t i = 0; i < skip && i < _SmoothCt; i++){
+		if(++_LastToneIndex >= _SmoothCt)
+			_LastToneIndex = 0;
+		_LastTones[_LastToneIndex] = -1;
+	}
+}
+
 int PtAKF::_GetSmoothTone(){
 	int tones[_SmoothCt];
 	int ct = 0;
@@ -147,12 +457,12 @@ void PtAKF::AddPeak(SPeak peaks[], float curWeight, int toneIndex){
 	}
 }
 
-int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float weights[_MaxHalfTone+1]){
+bool PtAKF::_BeginWindow(float* samples, float* restrict maxVolume){
 	// Calculate maximum volume
 
 	float maxVolumeL = 0;
-	for(int i = _SampleCt / 2; i < _SampleCt; i++){
-		float vol = abs(samples[i]);
+	for(size_t i = _SampleCt / 2; i < _SampleCt; i++){
+		float vol = std::abs(samples[i]);
 		if(vol > maxVolumeL)
 			maxVolumeL = vol;
 	}
@@ -160,70 +470,81 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 	*maxVolume = maxVolumeL;
 
 	if(maxVolumeL < _VolTreshold)
-		return -1;
+		return false;
 
-	float samplesWindowed[_SampleCt * 2];
+	float* samplesWindowed = _SamplesWindowed.data();
 
-	for(int i = 0; i < _SampleCt; i++){
+#ifdef USE_FFT
+	if(_Sliding){
+		// The window is applied implicitly. Only the lags of the tones are updated, so _AKFValues is only valid there (same scale as the FFT result)
+		_SlidingAKF.Update(samples, _WindowPosition);
+		_SlidingAKF.GetAKF(_AKFValues.data(), 2.f * _SampleCt);
+		return true;
+	}
+	_AKFPending = true; // Done by _CalcAutocorrelations
+#endif
+	for(size_t i = 0; i < _SampleCt; i++){
 		samplesWindowed[i] = samples[i] * _Window[i];
 	}
+	return true;
+}
 
 #ifdef USE_FFT
-	for(int i = _SampleCt; i < _SampleCt * 2; i++){
-		samplesWindowed[i] = 0.f;
+void PtAKF::_CalcAutocorrelations(PtAKF* const* trackers, int count){
+	for(int i = 0; i < count; i++){
+		PtAKF* tracker = trackers[i];
+		if(!tracker->_AKFPending)
+			continue;
+		// Collect the following trackers that can share the FFT plan of this one
+		float* in[_BatchSize];
+		float* out[_BatchSize];
+		int ct = 0;
+		for(int j = i; j < count && ct < _BatchSize; j++){
+			PtAKF* other = trackers[j];
+			if(other->_AKFPending && other->_SampleCt == tracker->_SampleCt && other->_MaxLag == tracker->_MaxLag){
+				in[ct] = other->_SamplesWindowed.data();
+				out[ct] = other->_AKFValues.data();
+				other->_AKFPending = false;
+				ct++;
+			}
+		}
+		if(ct == _BatchSize)
+			tracker->_FFTPlan->RealAutocorrelationBatch(in, out, ct, tracker->_MaxLag);
+		else{
+			for(int j = 0; j < ct; j++)
+				tracker->_FFTPlan->RealAutocorrelation(in[j], out[j], tracker->_MaxLag);
+		}
 	}
-	float samplesFFT[_SampleCt+1]; // +1 for middle value!
-	PowerSpectrum(_SampleCt*2, samplesWindowed, samplesFFT);
-	RealInverseRealFFT(_SampleCt*2, samplesFFT, _AKFValues);
+}
 #endif
+
+int PtAKF::_FinishWindow(float* samples, float* weights){
+	float* samplesWindowed = _SamplesWindowed.data();
 	// Now analyze the samples and get peaks at the most appropriate tones
 
-	//Attention: We have a peak at lag 0 that might stretch that far, that we detect a wrong "peak" at _MaxHalfTone
+	//Attention: We have a peak at lag 0 that might stretch that far, that we detect a wrong "peak" at _MaxTone
 	//Because of that we filter out all tones that are past the last zero crossing from below but keep tones with decreasing weights (going towards zero crossing from above)
-	int lastValidTone = 0;
-	float lastWeight = 1.f;
-	float maxWeight = 0.f;
-
-	//TODO: When using FFT this can be speed up a lot by only checking around the AKF peaks
-	for (int toneIndex = 0; toneIndex <= _MaxHalfTone; toneIndex++){
-		float curWeight = _AnalyzeByTone(samples, samplesWindowed, toneIndex);
-
-		weights[toneIndex] = curWeight;
-
-		if(curWeight > maxWeight){
-			maxWeight = curWeight;
-		}
-		if(lastWeight > curWeight || (lastWeight > 0.f && curWeight <= 0.f))
-			lastValidTone = toneIndex - 1;
-		lastWeight = curWeight;
-	}
-
-	// Now clear off the lag 0 peak if required
-
-	if(maxWeight >= weights[_MaxHalfTone]){
-		//We might have caught the lag 0 peak so go a bit further to check for other zero crossings (or we won't be able to detect _MaxHalfTone)
-		float lastWeight =  _AKFByTone(samples, _MaxHalfTone);
-		for(int toneIndex = _MaxHalfTone+1; toneIndex <= _MaxHalfTone + _HalfTonesAdd; toneIndex++){
-			float curWeight = _AKFByTone(samples, toneIndex);
-			if(lastWeight > curWeight || (lastWeight > 0.f && curWeight <= 0.f)){
-				lastValidTone = toneIndex - 1;
-				break;
-			}
-			lastWeight = curWeight;
-		}
-		if(lastValidTone < 0)
-			return -1;
-		//Set all invalid weights to 0
-		for(int toneIndex = lastValidTone + 1;toneIndex <= _MaxHalfTone; toneIndex++){
-			weights[toneIndex] = 0.f;
+	int lastValidTone;
+#ifdef USE_FFT
+	if(_PeakGuided)
+		lastValidTone = _CalcWeightsPeakGuided(samples, samplesWindowed, weights);
+	else
+#endif
+	{
+		for (int toneIndex = 0; toneIndex <= _MaxTone; toneIndex++){
+			weights[toneIndex] = _AnalyzeByTone(samples, samplesWindowed, toneIndex);
+			_WeightExact[toneIndex] = true;
 		}
+		lastValidTone = _GetLastValidTone(samples, samplesWindowed, weights);
 	}
+	if(lastValidTone < 0)
+		return -1;
 
 	SPeak peaks[_MaxPeaks];
 	InitPeaks(peaks);
 	int numPeaks = 0;
 	bool up = true;
-	for(int i = 1; i <= _MaxHalfTone; i++){
+	for(int i = 1; i <= _MaxTone; i++){
 		if(weights[i - 1] > weights[i]){
 			if(up){
 				AddPeak(peaks, weights[i - 1], i - 1);
@@ -234,8 +555,8 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 			up = true;
 		}
 	}
-	if(up && weights[_MaxHalfTone] > 0.001f){
-		AddPeak(peaks, weights[_MaxHalfTone], _MaxHalfTone);
+	if(up && weights[_MaxTone] > 0.001f){
+		AddPeak(peaks, weights[_MaxTone], _MaxTone);
 		numPeaks++;
 	}
 	if(numPeaks > _MaxPeaks)
@@ -245,7 +566,7 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 	// This is necessary because we may have our real peak a bit off the exact tone frequency
 	// and a 'wrong' peak that is exactly at another tone which might become higher than the one at the 'right' tone
 
-	maxWeight = peaks[_MaxPeaks-1].weight;
+	float maxWeight = peaks[_MaxPeaks-1].weight;
 	if(maxWeight < 0.00001f) // Just a small number to check for zero values
 		return -1;
 	int maxTone = peaks[_MaxPeaks-1].toneIndex;
@@ -255,7 +576,7 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 		if(curWeight * 3.f < maxWeight)
 			continue;
 		int toneIndex = peaks[i].toneIndex;
-		float curWeightDown = _AnalyzeBySampleCt(samples, samplesWindowed, _SamplesPerPeriodPerToneFine[toneIndex * 2]);
+		float curWeightDown = _AnalyzeIfAbove(samples, samplesWindowed, _SamplesPerPeriodPerToneFine[toneIndex * 2], curWeight);
 		int otherToneIndex;
 		int otherToneFineIndex;
 		if(curWeightDown > curWeight){
@@ -263,9 +584,9 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 			otherToneFineIndex = 1;
 			curWeight = curWeightDown;
 		}else{
-			float curWeightUp = _AnalyzeBySampleCt(samples,  samplesWindowed, _SamplesPerPeriodPerToneFine[toneIndex * 2 + 1]);
+			float curWeightUp = _AnalyzeIfAbove(samples,  samplesWindowed, _SamplesPerPeriodPerToneFine[toneIndex * 2 + 1], curWeight);
 			if(curWeightUp > curWeight){
-				otherToneIndex = (toneIndex < _MaxHalfTone) ? toneIndex + 1: -1; // If the other tone is invalid just set it to -1 which will be skipped below
+				otherToneIndex = (toneIndex < _MaxTone) ? toneIndex + 1: -1; // If the other tone is invalid just set it to -1 which will be skipped below
 				otherToneFineIndex = 0;
 				curWeight = curWeightUp;
 			}else
@@ -280,7 +601,7 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 
 		// Now check also neighbouring tone
 		if(otherToneIndex >= 0){
-			float curWeightOther = _AnalyzeBySampleCt(samples,  samplesWindowed, _SamplesPerPeriodPerToneFine[otherToneIndex * 2 + otherToneFineIndex]);
+			float curWeightOther = _AnalyzeIfAbove(samples,  samplesWindowed, _SamplesPerPeriodPerToneFine[otherToneIndex * 2 + otherToneFineIndex], weights[otherToneIndex]);
 			if(curWeightOther > weights[otherToneIndex]){
 				weights[otherToneIndex] = curWeightOther;
 				if(curWeightOther > maxWeight){
@@ -297,15 +618,107 @@ int PtAKF::_GetNote(float samples[_SampleCt], float* restrict maxVolume, float w
 
 	//if(maxWeight - minWeight > 0.025){
 	if(maxAKF >= 0.33f * energy){
-		return maxTone;
+		return _MinHalfTone + maxTone;
 	}else return -1;
 }
 
-float PtAKF::_AnalyzeByTone(float samples[_SampleCt], float samplesWindowed[_SampleCt], int toneIndex){
+bool PtAKF::_HasLag0Peak(float* samples){
+	//We might have caught the lag 0 peak so go a bit further to check for other zero crossings (or we won't be able to detect _MaxTone)
+	float lastWeight = _AKFByTone(samples, _MaxTone);
+	for(int toneIndex = _MaxTone+1; toneIndex <= _MaxTone + _HalfTonesAdd; toneIndex++){
+		float curWeight = _AKFByTone(samples, toneIndex);
+		if(lastWeight > curWeight || (lastWeight > 0.f && curWeight <= 0.f))
+			return false;
+		lastWeight = curWeight;
+	}
+	return true;
+}
+
+int PtAKF::_GetLastValidTone(float* samples, float* samplesWindowed, float* weights){
+	if(!_HasLag0Peak(samples))
+		return _MaxTone;
+	// Search the last tone (from above) where the weight falls or crosses zero from above
+	int lastValidTone = 0;
+	float curWeight = _ExactWeight(samples, samplesWindowed, weights, _MaxTone);
+	for(int toneIndex = _MaxTone; toneIndex >= 0; toneIndex--){
+		float lastWeight = (toneIndex > 0) ? _ExactWeight(samples, samplesWindowed, weights, toneIndex - 1) : 1.f;
+		if(lastWeight > curWeight || (lastWeight > 0.f && curWeight <= 0.f)){
+			lastValidTone = toneIndex - 1;
+			break;
+		}
+		curWeight = lastWeight;
+	}
+	if(lastValidTone < 0)
+		return -1;
+	//Set all invalid weights to 0
+	for(int toneIndex = lastValidTone + 1; toneIndex <= _MaxTone; toneIndex++){
+		weights[toneIndex] = 0.f;
+		_WeightExact[toneIndex] = true;
+	}
+	return lastValidTone;
+}
+
+float PtAKF::_ExactWeight(float* samples, float* samplesWindowed, float* weights, int toneIndex){
+	if(!_WeightExact[toneIndex]){
+		weights[toneIndex] = _AnalyzeByTone(samples, samplesWindowed, toneIndex);
+		_WeightExact[toneIndex] = true;
+	}
+	return weights[toneIndex];
+}
+
+#ifdef USE_FFT
+int PtAKF::_CalcWeightsPeakGuided(float* samples, float* samplesWindowed, float* weights){
+	// The AKF is already known for every lag, only the AMDF is expensive. AKF/(AMDF+1) cannot exceed the AKF (AMDF >= 0),
+	// and the peak search below only refines peaks of at least a third of the highest one. So skip tones whose AKF
+	// is below a third of the highest peak found so far. The AMDF cannot exceed 2 * maximum amplitude either,
+	// so tones whose AKF is below the smallest possible weight of a neighbour cannot be peaks and are skipped as well.
+	// Whether a tone is a peak only depends on its neighbours, so each candidate gets those, which keeps the result exact.
+	// Skipped tones get that smallest possible weight.
+	float minValue = 0.f, maxValue = 0.f;
+	SimdSumMinMax(samples, _SampleCt, &minValue, &maxValue);
+	float minAMDFFactor = 1.f / (2.01f * std::max(maxValue, -minValue) + 1.f); // Slightly lower against rounding errors of the AMDF
+
+	float* akf = _ToneAKF.data();
+	int maxAKFTone = 0;
+	for (int toneIndex = 0; toneIndex <= _MaxTone; toneIndex++){
+		akf[toneIndex] = _AKFByTone(samplesWindowed, toneIndex);
+		weights[toneIndex] = (akf[toneIndex] > 0.f) ? akf[toneIndex] * minAMDFFactor : akf[toneIndex];
+		_WeightExact[toneIndex] = false;
+		if(akf[toneIndex] > akf[maxAKFTone])
+			maxAKFTone = toneIndex;
+	}
+	int lastValidTone = _GetLastValidTone(samples, samplesWindowed, weights);
+	if(lastValidTone < 0)
+		return -1;
+
+	// Start with the highest AKF, which is usually the highest peak, so most of the others are skipped
+	float maxPeak = 0.f;
+	for (int i = -1; i <= lastValidTone; i++){
+		int toneIndex = (i < 0) ? std::min(maxAKFTone, lastValidTone) : i;
+		if(akf[toneIndex] * 3.f < maxPeak || akf[toneIndex] <= 0.f)
+			continue;
+		// weights holds the smallest possible weight of tones not calculated yet (0 past lastValidTone)
+		if((toneIndex > 0 && akf[toneIndex] < weights[toneIndex - 1]) || (toneIndex < _MaxTone && akf[toneIndex] <= weights[toneIndex + 1]))
+			continue;
+		// Same conditions as the peak detection in _FinishWindow
+		float curWeight = _ExactWeight(samples, samplesWindowed, weights, toneIndex);
+		bool isPeak = toneIndex == 0 || _ExactWeight(samples, samplesWindowed, weights, toneIndex - 1) <= curWeight;
+		if(toneIndex < _MaxTone)
+			isPeak = isPeak && curWeight > _ExactWeight(samples, samplesWindowed, weights, toneIndex + 1);
+		else
+			isPeak = isPeak && curWeight > 0.001f;
+		if(isPeak && curWeight > maxPeak)
+			maxPeak = curWeight;
+	}
+	return lastValidTone;
+}
+#endif
+
+float PtAKF::_AnalyzeByTone(float* samples, float* samplesWindowed, int toneIndex){
 	return _AnalyzeBySampleCt(samples, samplesWindowed, _SamplesPerPeriodPerTone[toneIndex]);
 }
 
-float PtAKF::_AnalyzeBySampleCt(float samples[_SampleCt], float samplesWindowed[_SampleCt], float samplesPerPeriodD){
+float PtAKF::_AnalyzeBySampleCt(float* samples, float* samplesWindowed, float samplesPerPeriodD){
 	// Use method by Kobayashi and Shimamura (2001): Combine AKF and AMDF to a new f(z)=AKF(z)/(AMDF(z)+k) with k=1
 
 	float akf = _AKFBySampleCt(samplesWindowed, samplesPerPeriodD);
@@ -317,59 +730,65 @@ float PtAKF::_AnalyzeBySampleCt(float samples[_SampleCt], float samplesWindowed[
 	//{toneIndex}: {accumDistAKF} ; {accumDistAMDF}; {result}
 }
 
-float PtAKF::_AKFByTone(float samples[_SampleCt], int toneIndex){
+float PtAKF::_AnalyzeIfAbove(float* samples, float* samplesWindowed, float samplesPerPeriodD, float threshold){
+#ifdef USE_FFT
+	// AKF/(AMDF+1) cannot exceed a positive AKF and is <= 0 otherwise, so skip the AMDF if the result could not pass the threshold anyway
+	if(_PeakGuided && threshold >= 0.f && _AKFBySampleCt(samplesWindowed, samplesPerPeriodD) <= threshold)
+		return threshold;
+#endif
+	return _AnalyzeBySampleCt(samples, samplesWindowed, samplesPerPeriodD);
+}
+
+float PtAKF::_AKFByTone(float* samples, int toneIndex){
 	return _AKFBySampleCt(samples, _SamplesPerPeriodPerTone[toneIndex]);
 }
 
-float PtAKF::_AKFBySampleCt(float samples[_SampleCt], float samplesPerPeriodD){
+float PtAKF::_AKFBySampleCt(float* samples, float samplesPerPeriodD){
 	int samplesPerPeriod = static_cast<int>(samplesPerPeriodD);
 	float fHigh = samplesPerPeriodD - samplesPerPeriod;
 	float fLow = 1.0f - fHigh;
 #ifdef USE_FFT
-	float akf2 = _AKFValues[samplesPerPeriod] * fLow + _AKFValues[samplesPerPeriod+1] * fHigh;
+	float akfLow = _AKFValues[samplesPerPeriod];
+	float akfHigh = _AKFValues[samplesPerPeriod+1];
+	if(_Sliding){
+		// Only the lags of the tones are up to date
+		if(!_SlidingAKF.IsTracked(samplesPerPeriod))
+			akfLow = _SlidingAKF.CalcAKF(samplesPerPeriod, 2.f * _SampleCt);
+		if(!_SlidingAKF.IsTracked(samplesPerPeriod + 1))
+			akfHigh = _SlidingAKF.CalcAKF(samplesPerPeriod + 1, 2.f * _SampleCt);
+	}
+	float akf2 = akfLow * fLow + akfHigh * fHigh;
 	return akf2 / (_SampleCt * _SampleCt);
 #else
 
-	float accumDist = 0; // accumulated distances
-
-	// compare correlating samples
-	int sampleIndex = 0; // index of sample to analyze
-	// Start value= index of sample one period ahead
-	for (int correlatingSampleIndex = sampleIndex + samplesPerPeriod; correlatingSampleIndex + 1 < _SampleCt; correlatingSampleIndex++, sampleIndex++)
-	{
-		// calc distance to corresponding sample in next period
-		float xn = samples[sampleIndex];
-		float xnt = samples[correlatingSampleIndex] * fLow + samples[correlatingSampleIndex + 1] * fHigh;
-		accumDist += xn * xnt;
-	}
+	// correlate each sample with the (interpolated) sample one period ahead
+	float accumDist = SimdDotInterp(samples, samples + samplesPerPeriod, _SampleCt - 1 - samplesPerPeriod, fLow, fHigh);
 
 	return accumDist / _SampleCt;
 #endif
 }
 
-float PtAKF::_AMDFByTone(float samples[_SampleCt], int toneIndex){
+float PtAKF::_AMDFByTone(float* samples, int toneIndex){
 	return _AMDFBySampleCt(samples, _SamplesPerPeriodPerTone[toneIndex]);
 }
 
-float PtAKF::_AMDFBySampleCt(float samples[_SampleCt], float samplesPerPeriodD){
+float PtAKF::_AMDFBySampleCt(float* samples, float samplesPerPeriodD){
 	int samplesPerPeriod = static_cast<int>(samplesPerPeriodD);
 	float fHigh = samplesPerPeriodD - samplesPerPeriod;
 	float fLow = 1.0f - fHigh;
-
-	float accumDist = 0; // accumulated distances
-
-	// compare correlating samples
-	int sampleIndex = 0; // index of sample to analyze
-	// Start value= index of sample one period ahead
-	for (int correlatingSampleIndex = sampleIndex + samplesPerPeriod; correlatingSampleIndex + 1 < _SampleCt; correlatingSampleIndex++, sampleIndex++)
-	{
-		// calc distance to corresponding sample in next period
-		float xn = samples[sampleIndex];
-		float xnt = samples[correlatingSampleIndex] * fLow + samples[correlatingSampleIndex + 1] * fHigh;
-		accumDist += abs_template(xn - xnt);
+#ifdef USE_FFT
+	float amdf;
+	if(_Sliding){
+		if(_SlidingAKF.GetAMDF(samplesPerPeriodD, &amdf))
+			return amdf;
 	}
+#endif
+
+	// distance of each sample to the (interpolated) sample one period ahead
+	int sampleCt = _SampleCt - 1 - samplesPerPeriod;
+	float accumDist = SimdAbsDiffInterp(samples, samples + samplesPerPeriod, sampleCt, fLow, fHigh);
 
-	return accumDist / sampleIndex;
+	return accumDist / sampleCt;
 }
 /*
 
@@ -1,5 +1,10 @@
 #pragma once
 #include "performous/pitch.hh"
+#include "SlidingAKF.h"
+#include "PitchWorker.h"
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #if __STDC__ != 1
 #    define restrict __restrict
@@ -20,56 +25,184 @@ struct SPeak{
 	float weight;
 };
 
+/** Result of a tracker for PtAKF::AnalyzeToResults, laid out for passing an array of it to managed code.
+    Holds the weights of the default tone range, trackers with fewer tones set the others to 0.
+    Trackers with more tones do not fit (PtAKF_AnalyzeBatch rejects them). **/
+struct SNoteResult{
+	static constexpr int ResultTones = 57;
+	int note;
+	float maxVolume;
+	float weights[ResultTones];
+};
+
+struct SAKFTables;
+class FFTPlan;
+
 // A pitch detection that is based on the AKF and AMDF (initially from original Vocaluxe/USDx)
 class PtAKF{
 public:
-	PtAKF(unsigned step);
+	/** Analyze windows of sampleCt samples (power of 2) recorded with sampleRate for the half tones minHalfTone..maxHalfTone (0 = C2).
+	    Throws std::invalid_argument if the tones do not fit into the window. **/
+	PtAKF(unsigned step, double sampleRate = 44100., int minHalfTone = 0, int maxHalfTone = _DefaultMaxHalfTone, size_t sampleCt = _DefaultSampleCt);
 	~PtAKF();
 
 	/** Add input data to buffer. This is thread-safe (against other functions). **/
 	template <typename InIt> void input(InIt begin, InIt end) {
 		_AnalysisBuf.insert(begin, end);
+		_NotifyWorker();
+	}
+	/** Add signed 16 bit input data to buffer, converting it on the fly. **/
+	void inputShort(short const* begin, short const* end) {
+		_AnalysisBuf.insertShort(begin, end);
+		_NotifyWorker();
 	}
+	/** Input frameCount frames of channelCount interleaved 16 bit channels (one pass over frames), channel c goes to trackers[c].
+	    Trackers may be NULL to ignore a channel, but none may be given twice. Returns false if channelCount is not in [1, MaxInterleavedChannels]. **/
+	static bool InputInterleaved(PtAKF* const* trackers, int channelCount, const short* frames, size_t frameCount);
+	static constexpr int MaxInterleavedChannels = 16;
 
+	/** Analyze the new input and return the note (-1 for none) of the newest windows. If the tracker was added to a PitchWorker,
+	    this only returns the latest result of the worker: Like without new input, repeated calls return the last tone with a lower volume
+	    and keep the weights until the worker analyzed more. **/
 	int GetNote(float* restrict maxVolume, float* restrict weights);
+	/** GetNote for several trackers at once (e.g. one per player) with the same results as calling GetNote for each of them.
+	    No tracker may be given twice. The weights of each tracker (GetToneCount() values) follow those of the previous one.
+	    The FFT autocorrelations of trackers with the same window size are calculated together, _BatchSize in one SIMD pass.
+	    The maxMicros of SetBacklogPolicy count from the start of the call for every tracker, so they limit the time of the whole batch.
+	    Trackers added to a PitchWorker only read their latest result like GetNote. The runs of other trackers between them are
+	    analyzed together, the time limit then counts from the start of each run. **/
+	static void GetNotes(PtAKF* const* trackers, int count, int* notes, float* maxVolumes, float* weights);
+	/** GetNotes storing note, volume and weights of each tracker in results. The weights are those of the last analyzed window
+	    (like a weights buffer passed to GetNote every time). PitchWorker::AnalyzeBatch spreads this over several threads.
+	    Only the first SNoteResult::ResultTones weights are stored, so only pass trackers with at most that many tones.
+	    As for GetNotes no tracker may be given twice (PtAKF_AnalyzeBatch returns false then). **/
+	static void AnalyzeToResults(PtAKF* const* trackers, int count, SNoteResult* results);
 	void SetVolumeThreshold(float threshold);
 	float GetVolumeThreshold(){return _VolTreshold;}
-	static int GetNumHalfTones(){ return _MaxHalfTone + 1;}
+	/** Only calculate the AMDF for tones whose weight can still matter (requires USE_FFT, off by default):
+	    AKF/(AMDF+1) cannot exceed the AKF, so tones whose AKF is below a third of the highest weight peak found so far are skipped.
+	    The detected notes are the same as with the full search, but the skipped weights are only a lower bound (AKF scaled by the smallest possible AMDF factor). **/
+	void SetPeakGuidedSearch(bool enabled){_PeakGuided = enabled;}
+	bool GetPeakGuidedSearch(){return _PeakGuided;}
+	/** Update the AKF and the (exact) AMDF of the tones incrementally from window to window instead of using a full FFT (requires USE_FFT).
+	    The cost grows with the step, so it is enabled by default only for steps up to sampleCt / _SlidingStepRatio. **/
+	void SetSlidingWindow(bool enabled);
+	bool GetSlidingWindow(){return _Sliding;}
+	/** Limit the work of GetNote when a lot of input piled up: Only analyze the newest maxWindows windows
+	    and stop after about maxMicros microseconds (of the whole call for GetNotes), dropping the rest. 0 means no limit. **/
+	void SetBacklogPolicy(unsigned maxWindows, unsigned maxMicros){_MaxWindows = maxWindows; _MaxMicros = maxMicros;}
+	/** Number of half tones with the default range **/
+	static int GetNumHalfTones(){ return _DefaultMaxHalfTone + 1;}
+	/** Number of half tones analyzed by this instance (size of the weights passed to GetNote) **/
+	int GetToneCount(){ return _MaxTone + 1;}
+	int GetMinHalfTone(){ return _MinHalfTone;}
 
 private:
-	static int _InitCount;
-	static float* restrict _SamplesPerPeriodPerTone;
-	// Use a 3 times finer resolution for exact peak detection
-	// So this array will store for each note the number of samples 1/3 below and up
-	// (cannot use halves as it would be ambiguous)
-	static float* restrict _SamplesPerPeriodPerToneFine;
-	static float* restrict _Window;
-	//static constexpr int _MinHalfTone = 0;  //C2
-	static constexpr int _MaxHalfTone = 56;//47; //B5
+	friend class PitchWorker;
+
+	static constexpr int _DefaultMaxHalfTone = 56;//47; //B5
+	static_assert(SNoteResult::ResultTones == _DefaultMaxHalfTone + 1, "SNoteResult must hold the weights of the default tone range");
+	constexpr static size_t _DefaultSampleCt = 2048;
+	constexpr static size_t _MinSampleCt = 256;
+	constexpr static size_t _MaxSampleCt = 4096;
 	static constexpr int _HalfTonesAdd = 4; //Additonal half tones to analyze to remove the peak at lag 0
 	static constexpr int _MaxPeaks = 10;
 	static constexpr int _SmoothCt = 3; //Number of samples used for smoothing the result
+	static constexpr size_t _SlidingStepRatio = 16; //The sliding window is faster than the FFT for steps up to about a 16th of the window (measured for 1024 to 4096 samples)
+	static constexpr int _BatchSize = 4; //Number of autocorrelations done together by GetNotes (FFTPlan::MaxBatchChannels, smaller batches are not faster than single ones)
 
-	constexpr static size_t _SampleCt = 2048;
-	RingBuffer<_SampleCt * 2> _AnalysisBuf;
+	enum EBatchState{
+		BATCH_IDLE, // No window available
+		BATCH_RUNNING,
+		BATCH_DONE, // All windows analyzed
+		BATCH_OUT_OF_TIME
+	};
+
+	std::shared_ptr<const SAKFTables> _Tables;
+	// Pointers into _Tables
+	const float* restrict _SamplesPerPeriodPerTone;
+	// Use a 3 times finer resolution for exact peak detection
+	// So this array will store for each note the number of samples 1/3 below and up
+	// (cannot use halves as it would be ambiguous)
+	const float* restrict _SamplesPerPeriodPerToneFine;
+	const float* restrict _Window;
+	int _MinHalfTone; // Half tone of tone index 0 (0 = C2)
+	int _MaxTone; // Highest tone index to analyze
+	size_t _SampleCt;
+
+	RingBuffer<_MaxSampleCt * 2> _AnalysisBuf;
 	unsigned _Step;
 	float _VolTreshold;
 	float _LastMaxVol;
+	bool _PeakGuided;
+	unsigned _MaxWindows;
+	unsigned _MaxMicros;
+	bool _Sliding;
 	int _LastTones[_SmoothCt];
 	int _LastToneIndex;
+	// State of GetNotes
+	EBatchState _BatchState;
+	bool _WindowPending; // The current window passed the volume check and needs to be analyzed
+	float* _BatchWeights;
+	// Buffers for the analysis
+	std::vector<float> _Samples;
+	std::vector<float> _SamplesWindowed;
+	std::vector<float> _ToneAKF;
+	std::vector<char> _WeightExact; // The weight of the tone is AKF/(AMDF+1) and not only a lower bound
 #ifdef USE_FFT
-	float _AKFValues[_SampleCt*2];
+	std::unique_ptr<FFTPlan> _FFTPlan; // for 2 * _SampleCt samples (zero padded)
+	int _MaxLag; // Largest lag any tone needs, _AKFValues is only valid up to it
+	std::vector<float> _AKFValues;
+	SlidingAKF _SlidingAKF;
+	size_t _WindowPosition; // Stream position of the window passed to _BeginWindow
+	bool _AKFPending; // The autocorrelation of _SamplesWindowed is still missing
 #endif
+	// Analysis by a PitchWorker
+	std::atomic<PitchWorker*> _Worker; // Set while added to a worker
+	std::atomic<int> _Notifying; // Number of _NotifyWorker calls that may still use _Worker
+	unsigned _WorkerThread;
+	std::atomic<bool> _InputPending;
+	std::vector<float> _OwnWeights; // Weights buffer for the analysis by a worker or AnalyzeBatch, keeps those of the last window
+	NoteSnapshot _Snapshot;
+	// Reader side of _Snapshot (thread calling GetNote)
+	unsigned _SnapshotSeen; // Version returned by the last GetNote
+	int _SnapshotLastTone;
+	float _SnapshotMaxVolume;
+	std::vector<float> _SnapshotWeights; // Weights of the snapshot for AnalyzeToResults
+	std::vector<float> _SnapshotRead; // Copy of the snapshot weights, only used if it is consistent
 
-	int _GetNote(float samples[_SampleCt], float* restrict maxVolume, float weights[_MaxHalfTone+1]);
+	// The analysis of a window is split, so GetNotes can calculate the autocorrelations of several trackers in between
+	bool _BeginWindow(float* samples, float* restrict maxVolume);
+	int _FinishWindow(float* samples, float* weights);
+	/** True if the AKF still rises beyond _MaxTone, so the lag 0 peak reaches into the analyzed tones **/
+	bool _HasLag0Peak(float* samples);
+	/** Last tone before the lag 0 peak: Tones past the last zero crossing from below are invalid, but tones with decreasing weights
+	    (going towards the zero crossing from above) are kept. -1 if there is none **/
+	int _GetLastValidTone(float* samples, float* samplesWindowed, float* weights);
+	inline float _ExactWeight(float* samples, float* samplesWindowed, float* weights, int toneIndex);
 	int _GetSmoothTone();
+	/** The analysis done by GetNotes (without a worker). Uses _OwnWeights of each tracker if weights is NULL. **/
+	static void _AnalyzeNotes(PtAKF* const* trackers, int count, int* notes, float* maxVolumes, float* weights);
+	void _NotifyWorker();
+	/** Clear _Worker and wait until no _NotifyWorker uses the worker anymore **/
+	void _DetachWorker();
+	void _AnalyzeInBackground();
+	int _GetBackgroundNote(float* maxVolume, float* weights);
+	size_t _WindowsAvailable();
+	void _SkipBacklog(size_t keepWindows);
+#ifdef USE_FFT
+	static void _CalcAutocorrelations(PtAKF* const* trackers, int count);
+	/** Calculates the weights needed to find the same note as the full search and returns the last valid tone (see _GetLastValidTone) **/
+	int _CalcWeightsPeakGuided(float* samples, float* samplesWindowed, float* weights);
+#endif
 
-	float _AnalyzeBySampleCt(float samples[_SampleCt], float samplesWindowed[_SampleCt], float samplesPerPeriodD);
-	inline float _AnalyzeByTone(float samples[_SampleCt], float samplesWindowed[_SampleCt], int toneIndex);
-	float _AKFBySampleCt(float samples[_SampleCt], float samplesPerPeriodD);
-	inline float _AKFByTone(float samples[_SampleCt], int toneIndex);
-	static float _AMDFBySampleCt(float samples[_SampleCt], float samplesPerPeriodD);
-	static inline float _AMDFByTone(float samples[_SampleCt], int toneIndex);
+	float _AnalyzeBySampleCt(float* samples, float* samplesWindowed, float samplesPerPeriodD);
+	float _AnalyzeIfAbove(float* samples, float* samplesWindowed, float samplesPerPeriodD, float threshold);
+	inline float _AnalyzeByTone(float* samples, float* samplesWindowed, int toneIndex);
+	float _AKFBySampleCt(float* samples, float samplesPerPeriodD);
+	inline float _AKFByTone(float* samples, int toneIndex);
+	float _AMDFBySampleCt(float* samples, float samplesPerPeriodD);
+	inline float _AMDFByTone(float* samples, int toneIndex);
 	static inline void InitPeaks(SPeak peaks[_MaxPeaks]);
 	static inline void AddPeak(SPeak peaks[_MaxPeaks], float curWeight, int toneIndex);
 };
\ No newline at end of file